@@ -0,0 +1,67 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __BITMAP_H__
+#define __BITMAP_H__
+
+/**
+ * Bitmap of arbitrary length in an array of 64-bit words. Scanning for the
+ * set bits skips 64 clear bits at a time, so a sparse bitmap over many
+ * entries is visited in the time proportional to its words and set bits.
+ */
+#define BITMAP_WORDS(nr)	(((nr) + 63) / 64)
+
+static inline void bitmap_set(unsigned long long *bitmap, unsigned int n)
+{
+	bitmap[n / 64] |= 1ULL << (n % 64);
+}
+
+static inline void bitmap_clear(unsigned long long *bitmap, unsigned int n)
+{
+	bitmap[n / 64] &= ~(1ULL << (n % 64));
+}
+
+static inline int bitmap_test(const unsigned long long *bitmap, unsigned int n)
+{
+	return (bitmap[n / 64] >> (n % 64)) & 1;
+}
+
+/**
+ * bitmap_next - the first set bit at or after @from, or @nr if none
+ */
+static inline unsigned int bitmap_next(const unsigned long long *bitmap,
+		unsigned int nr, unsigned int from)
+{
+	unsigned int word = from / 64;
+	unsigned long long bits;
+
+	if (from >= nr) return nr;
+
+	bits = bitmap[word] & (~0ULL << (from % 64));
+	while (!bits) {
+		if (++word >= BITMAP_WORDS(nr)) return nr;
+		bits = bitmap[word];
+	}
+	from = word * 64 + __builtin_ctzll(bits);
+	return from < nr ? from : nr;
+}
+
+/**
+ * bitmap_for_each_set - iterate @n over the set bits of @bitmap in @nr bits
+ */
+#define bitmap_for_each_set(n, bitmap, nr) \
+	for (n = bitmap_next(bitmap, nr, 0); n < (nr); n = bitmap_next(bitmap, nr, n + 1))
+
+#endif
@@ -0,0 +1,302 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "eventlog.h"
+
+#define EVENTLOG_MASK	(EVENTLOG_RING_SIZE - 1)
+
+/* Longest record in JSON Lines */
+#define MAX_JSON_LEN	160
+
+static const char * const __event_names[] = {
+	[TRACE_FORK] = "fork",
+	[TRACE_EXIT] = "exit",
+	[TRACE_BLOCK] = "block",
+	[TRACE_ACQUIRE] = "acquire",
+	[TRACE_RELEASE] = "release",
+	[TRACE_RUN] = "run",
+	[TRACE_IDLE] = "idle",
+};
+
+static void __write_out(struct eventlog *log)
+{
+	size_t written = 0;
+
+	/* Once failed, the rest is dropped. eventlog_close() reports it */
+	while (written < log->len && !log->failed) {
+		ssize_t ret = write(log->fd, log->buffer + written, log->len - written);
+		if (ret < 0 && errno == EINTR) continue;
+		if (ret <= 0) {
+			log->failed = true;
+			break;
+		}
+		written += ret;
+	}
+
+	log->nr_bytes += written;
+	log->len = 0;
+}
+
+static void __format_json(struct eventlog *log, const struct eventlog_record *rec)
+{
+	char *s = log->buffer + log->len;
+	int len;
+
+	if (rec->type == EVENTLOG_PRIO) {
+		len = sprintf(s, "{\"tick\":%u,\"cpu\":%u,\"pid\":%u,\"event\":\"prio\","
+				"\"from\":%d,\"prio\":%u}\n",
+				rec->tick, rec->cpu, rec->pid, rec->arg, rec->prio);
+	} else if (rec->type == TRACE_IDLE) {
+		len = sprintf(s, "{\"tick\":%u,\"cpu\":%u,\"event\":\"idle\",\"ticks\":%d}\n",
+				rec->tick, rec->cpu, rec->arg);
+	} else {
+		len = sprintf(s, "{\"tick\":%u,\"cpu\":%u,\"pid\":%u,\"event\":\"%s\"",
+				rec->tick, rec->cpu, rec->pid, __event_names[rec->type]);
+		if (rec->type == TRACE_ACQUIRE || rec->type == TRACE_RELEASE) {
+			len += sprintf(s + len, ",\"resource\":%d", rec->arg);
+		} else if (rec->type == TRACE_RUN) {
+			len += sprintf(s + len, ",\"ticks\":%d", rec->arg);
+		}
+		len += sprintf(s + len, ",\"prio\":%u}\n", rec->prio);
+	}
+	log->len += len;
+}
+
+/**
+ * Let the simulation know that the records up to @tail are taken, and wake
+ * it up if it is waiting for the space
+ */
+static void __release_records(struct eventlog *log, unsigned long long tail)
+{
+	__atomic_store_n(&log->tail, tail, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&log->waiting, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&log->lock);
+		pthread_cond_signal(&log->space);
+		pthread_mutex_unlock(&log->lock);
+	}
+}
+
+static void *__writer(void *arg)
+{
+	struct eventlog *log = arg;
+	unsigned long long tail = log->tail;
+
+	for (;;) {
+		unsigned long long head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+
+		/* Nothing to take for now. Sleep until kicked */
+		if (head == tail) {
+			pthread_mutex_lock(&log->lock);
+			__atomic_store_n(&log->sleeping, true, __ATOMIC_SEQ_CST);
+			while (__atomic_load_n(&log->head, __ATOMIC_SEQ_CST) == tail &&
+					!log->closing) {
+				pthread_cond_wait(&log->records, &log->lock);
+			}
+			__atomic_store_n(&log->sleeping, false, __ATOMIC_RELAXED);
+			if (log->closing &&
+					__atomic_load_n(&log->head, __ATOMIC_ACQUIRE) == tail) {
+				pthread_mutex_unlock(&log->lock);
+				break;
+			}
+			pthread_mutex_unlock(&log->lock);
+			continue;
+		}
+
+		while (tail != head) {
+			const struct eventlog_record *rec = log->ring + (tail & EVENTLOG_MASK);
+
+			if (log->json) {
+				if (log->len + MAX_JSON_LEN > EVENTLOG_BUFFER_SIZE) __write_out(log);
+				__format_json(log, rec);
+			} else {
+				if (log->len + sizeof(*rec) > EVENTLOG_BUFFER_SIZE) __write_out(log);
+				memcpy(log->buffer + log->len, rec, sizeof(*rec));
+				log->len += sizeof(*rec);
+			}
+
+			/* Give the space back as we go, so the simulation need not wait long */
+			if (!(++tail % EVENTLOG_BATCH)) __release_records(log, tail);
+		}
+		__release_records(log, tail);
+	}
+
+	return NULL;
+}
+
+struct eventlog *eventlog_open(const char *filename, bool json)
+{
+	struct eventlog *log;
+	void *mem;
+
+	if (posix_memalign(&mem, 64, sizeof(*log))) {
+		fprintf(stderr, "Cannot allocate the event log\n");
+		return NULL;
+	}
+	log = mem;
+	memset(log, 0, sizeof(*log));
+	log->json = json;
+
+	log->ring = malloc(sizeof(*log->ring) * EVENTLOG_RING_SIZE);
+	log->buffer = malloc(EVENTLOG_BUFFER_SIZE);
+	if (!log->ring || !log->buffer) {
+		fprintf(stderr, "Cannot allocate the event log\n");
+		goto out_free;
+	}
+
+	log->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (log->fd < 0) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		goto out_free;
+	}
+
+	if (!json) {
+		struct eventlog_header header = {
+			.magic = EVENTLOG_MAGIC,
+			.version = EVENTLOG_VERSION,
+			.record_size = sizeof(struct eventlog_record),
+		};
+
+		memcpy(log->buffer, &header, sizeof(header));
+		log->len = sizeof(header);
+	}
+
+	pthread_mutex_init(&log->lock, NULL);
+	pthread_cond_init(&log->records, NULL);
+	pthread_cond_init(&log->space, NULL);
+
+	if (pthread_create(&log->writer, NULL, __writer, log)) {
+		fprintf(stderr, "Cannot start the writer of %s\n", filename);
+		pthread_cond_destroy(&log->space);
+		pthread_cond_destroy(&log->records);
+		pthread_mutex_destroy(&log->lock);
+		close(log->fd);
+		goto out_free;
+	}
+	return log;
+
+out_free:
+	free(log->buffer);
+	free(log->ring);
+	free(log);
+	return NULL;
+}
+
+/**
+ * Wake the writer up if it is waiting for records
+ */
+static void __kick(struct eventlog *log)
+{
+	log->kicked = log->head;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&log->sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&log->lock);
+		pthread_cond_signal(&log->records);
+		pthread_mutex_unlock(&log->lock);
+	}
+}
+
+static inline unsigned long long __elapsed_ns(const struct timespec *from)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - from->tv_sec) * 1000000000ULL + now.tv_nsec - from->tv_nsec;
+}
+
+/**
+ * Wait for the writer to take some records out of the full ring
+ */
+static void __wait_for_space(struct eventlog *log)
+{
+	struct timespec start;
+
+	log->stats.nr_stalls++;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	__kick(log);
+
+	pthread_mutex_lock(&log->lock);
+	for (;;) {
+		__atomic_store_n(&log->waiting, true, __ATOMIC_SEQ_CST);
+		log->tail_seen = __atomic_load_n(&log->tail, __ATOMIC_SEQ_CST);
+		if (log->head - log->tail_seen < EVENTLOG_RING_SIZE) break;
+
+		pthread_cond_wait(&log->space, &log->lock);
+	}
+	__atomic_store_n(&log->waiting, false, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&log->lock);
+
+	log->stats.stalled_ns += __elapsed_ns(&start);
+}
+
+void eventlog_event(struct eventlog *log, unsigned int tick, unsigned int cpu,
+		unsigned int pid, unsigned int type, int arg, unsigned int prio)
+{
+	struct eventlog_record *rec;
+
+	if (log->head - log->tail_seen >= EVENTLOG_RING_SIZE) {
+		log->tail_seen = __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE);
+		if (log->head - log->tail_seen >= EVENTLOG_RING_SIZE) {
+			__wait_for_space(log);
+		}
+	}
+
+	rec = log->ring + (log->head & EVENTLOG_MASK);
+	rec->tick = tick;
+	rec->pid = pid;
+	rec->cpu = cpu;
+	rec->type = type;
+	rec->arg = arg;
+	rec->prio = prio;
+
+	__atomic_store_n(&log->head, log->head + 1, __ATOMIC_RELEASE);
+	log->stats.nr_records++;
+
+	if (log->head - log->kicked >= EVENTLOG_BATCH) __kick(log);
+}
+
+void eventlog_close(struct eventlog *log, struct eventlog_stats *stats)
+{
+	pthread_mutex_lock(&log->lock);
+	log->closing = true;
+	pthread_cond_signal(&log->records);
+	pthread_mutex_unlock(&log->lock);
+
+	pthread_join(log->writer, NULL);
+	if (log->len) __write_out(log);
+
+	log->stats.nr_bytes = log->nr_bytes;
+	log->stats.failed = log->failed;
+	if (stats) *stats = log->stats;
+
+	close(log->fd);
+	pthread_cond_destroy(&log->space);
+	pthread_cond_destroy(&log->records);
+	pthread_mutex_destroy(&log->lock);
+	free(log->buffer);
+	free(log->ring);
+	free(log);
+}
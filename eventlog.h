@@ -0,0 +1,140 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __EVENTLOG_H__
+#define __EVENTLOG_H__
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "trace.h"
+
+/**
+ * Machine-readable log of the simulation events, next to the trace. The
+ * simulation thread puts fixed-size records into a single-producer single-
+ * consumer ring without locking, and a writer thread of the log drains the
+ * ring and writes the records out in large chunks. So neither formatting
+ * nor I/O happens on the simulation thread. When the ring is full, the
+ * simulation waits for the writer, counting how many times and how long it
+ * waited.
+ *
+ * The log is written as the records below following the header, in the
+ * host byte order, or in JSON Lines with one object per record.
+ */
+#define EVENTLOG_MAGIC		"PSIMELOG"
+#define EVENTLOG_VERSION	1
+
+/**
+ * Types of the records. The events of the trace keep their enum trace_type
+ */
+#define EVENTLOG_PRIO		0x10	/* The priority changed from @arg to @prio */
+
+struct eventlog_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+};
+
+/**
+ * @arg is the resource id for TRACE_ACQUIRE and TRACE_RELEASE, the number of
+ * ticks for TRACE_RUN and TRACE_IDLE, and the previous priority for
+ * EVENTLOG_PRIO. @prio is the priority of @pid after the event, and both
+ * are zero for TRACE_IDLE.
+ */
+struct eventlog_record {
+	uint32_t tick;
+	uint32_t pid;
+	uint16_t cpu;
+	uint16_t type;
+	int32_t arg;
+	uint32_t prio;
+};
+
+#define EVENTLOG_RING_SIZE		(1 << 16)	/* In records, a power of two */
+#define EVENTLOG_BATCH			1024		/* Records to kick the writer for */
+#define EVENTLOG_BUFFER_SIZE	(1 << 20)
+
+struct eventlog_stats {
+	unsigned long long nr_records;
+	unsigned long long nr_bytes;		/* Written to the file */
+	unsigned long long nr_stalls;		/* # of times the ring was full */
+	unsigned long long stalled_ns;		/* Time waited for the writer then */
+	bool failed;						/* The writer could not write */
+};
+
+struct eventlog {
+	int fd;
+	bool json;
+	struct eventlog_record *ring;
+
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t records;		/* The writer waits for records on this */
+	pthread_cond_t space;		/* and the simulation waits for space */
+
+	/* Owned by the simulation thread */
+	unsigned long long head __attribute__((aligned(64)));
+								/* # of records put into @ring */
+	unsigned long long tail_seen;	/* @tail when looked at last */
+	unsigned long long kicked;	/* @head when the writer was kicked last */
+	bool closing;
+	bool waiting;				/* for @space */
+	struct eventlog_stats stats;
+
+	/* Owned by the writer thread */
+	unsigned long long tail __attribute__((aligned(64)));
+								/* # of records taken out of @ring */
+	bool sleeping;				/* waiting for @records */
+	unsigned long long nr_bytes;
+	bool failed;
+	char *buffer;
+	size_t len;
+};
+
+/***********************************************************************
+ * eventlog_open()
+ *
+ * DESCRIPTION
+ *   Create the event log @filename and start its writer thread. The log is
+ *   written in JSON Lines if @json is true.
+ *
+ * RETURN
+ *   The event log, or NULL on error
+ */
+struct eventlog *eventlog_open(const char *filename, bool json);
+
+/***********************************************************************
+ * eventlog_event()
+ *
+ * DESCRIPTION
+ *   Log event @type of process @pid on processor @cpu at @tick. See struct
+ *   eventlog_record for @arg and @prio. It waits for the writer if the ring
+ *   is full.
+ */
+void eventlog_event(struct eventlog *log, unsigned int tick, unsigned int cpu,
+		unsigned int pid, unsigned int type, int arg, unsigned int prio);
+
+/***********************************************************************
+ * eventlog_close()
+ *
+ * DESCRIPTION
+ *   Wait for the writer to write out all the records, close the file, and
+ *   release @log. The statistics of the log are copied into @stats unless
+ *   it is NULL.
+ */
+void eventlog_close(struct eventlog *log, struct eventlog_stats *stats);
+
+#endif
@@ -0,0 +1,103 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+
+#include "types.h"
+#include "heap.h"
+
+void heap_init(struct heap *heap)
+{
+	heap->nodes = NULL;
+	heap->nr_nodes = 0;
+	heap->capacity = 0;
+	heap->seq = 0;
+}
+
+void heap_fini(struct heap *heap)
+{
+	free(heap->nodes);
+	heap_init(heap);
+}
+
+static inline int __less(struct heap_node *a, struct heap_node *b)
+{
+	return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+int heap_push(struct heap *heap, unsigned long long key, void *data)
+{
+	struct heap_node node = {
+		.key = key,
+		.seq = heap->seq++,
+		.data = data,
+	};
+	unsigned int i;
+
+	if (heap->nr_nodes == heap->capacity) {
+		unsigned int capacity = heap->capacity ? heap->capacity * 2 : 64;
+		struct heap_node *nodes =
+				realloc(heap->nodes, sizeof(*nodes) * capacity);
+		if (!nodes) return -1;
+
+		heap->nodes = nodes;
+		heap->capacity = capacity;
+	}
+
+	/* Sift up */
+	for (i = heap->nr_nodes++; i > 0; ) {
+		unsigned int parent = (i - 1) / 2;
+
+		if (!__less(&node, heap->nodes + parent)) break;
+
+		heap->nodes[i] = heap->nodes[parent];
+		i = parent;
+	}
+	heap->nodes[i] = node;
+
+	return 0;
+}
+
+void *heap_pop(struct heap *heap)
+{
+	struct heap_node last;
+	void *data;
+	unsigned int i = 0;
+
+	if (!heap->nr_nodes) return NULL;
+
+	data = heap->nodes[0].data;
+	last = heap->nodes[--heap->nr_nodes];
+
+	/* Sift the last one down from the root */
+	while (true) {
+		unsigned int child = i * 2 + 1;
+
+		if (child >= heap->nr_nodes) break;
+		if (child + 1 < heap->nr_nodes &&
+				__less(heap->nodes + child + 1, heap->nodes + child)) {
+			child++;
+		}
+		if (!__less(heap->nodes + child, &last)) break;
+
+		heap->nodes[i] = heap->nodes[child];
+		i = child;
+	}
+	if (heap->nr_nodes) {
+		heap->nodes[i] = last;
+	}
+
+	return data;
+}
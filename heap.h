@@ -0,0 +1,76 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __HEAP_H__
+#define __HEAP_H__
+
+/**
+ * Binary min-heap of pointers keyed by integers. Entries with the same key
+ * come out in the order they are pushed, which makes the schedulers built
+ * on top of it deterministic. Use a negated key for a max-heap.
+ */
+struct heap_node {
+	unsigned long long key;
+	unsigned long long seq;	/* Push order to break ties */
+	void *data;
+};
+
+struct heap {
+	struct heap_node *nodes;
+	unsigned int nr_nodes;
+	unsigned int capacity;
+	unsigned long long seq;
+};
+
+void heap_init(struct heap *heap);
+void heap_fini(struct heap *heap);
+
+/***********************************************************************
+ * heap_push()
+ *
+ * DESCRIPTION
+ *   Put @data into @heap with @key.
+ *
+ * RETURN
+ *   0 on success, or -1 if the heap cannot grow
+ */
+int heap_push(struct heap *heap, unsigned long long key, void *data);
+
+/***********************************************************************
+ * heap_pop()
+ *
+ * DESCRIPTION
+ *   Take out the entry with the smallest key, the earliest pushed one among
+ *   the ties.
+ *
+ * RETURN
+ *   The data of the entry, or NULL if @heap is empty
+ */
+void *heap_pop(struct heap *heap);
+
+/**
+ * heap_top - the entry heap_pop() would take out, or NULL if empty
+ */
+static inline struct heap_node *heap_top(struct heap *heap)
+{
+	return heap->nr_nodes ? heap->nodes : NULL;
+}
+
+static inline int heap_empty(struct heap *heap)
+{
+	return heap->nr_nodes == 0;
+}
+
+#endif
@@ -0,0 +1,83 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <string.h>
+
+#include "histogram.h"
+
+void histogram_init(struct histogram *h)
+{
+	memset(h, 0x00, sizeof(*h));
+}
+
+static unsigned int __bucket_of(unsigned long long value)
+{
+	unsigned int order;
+
+	if (value < HISTOGRAM_SUBS) return value;
+
+	order = 63 - __builtin_clzll(value);
+	return (order - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUBS +
+			((value >> (order - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUBS - 1));
+}
+
+/**
+ * The largest value that falls into @bucket
+ */
+static unsigned long long __bucket_limit(unsigned int bucket)
+{
+	unsigned int shift;
+	unsigned long long base;
+
+	if (bucket < HISTOGRAM_SUBS) return bucket;
+
+	shift = bucket / HISTOGRAM_SUBS - 1;
+	base = (unsigned long long)(HISTOGRAM_SUBS + bucket % HISTOGRAM_SUBS) << shift;
+	return base + ((1ULL << shift) - 1);
+}
+
+void histogram_add(struct histogram *h, unsigned long long value)
+{
+	if (!h->nr || value < h->min) h->min = value;
+	if (value > h->max) h->max = value;
+
+	h->nr++;
+	h->sum += value;
+	h->buckets[__bucket_of(value)]++;
+}
+
+unsigned long long histogram_percentile(const struct histogram *h, double percent)
+{
+	unsigned long long rank;
+	unsigned long long seen = 0;
+
+	if (!h->nr) return 0;
+
+	rank = (unsigned long long)(h->nr * percent / 100);
+	if (rank < h->nr * percent / 100) rank++;
+	if (rank < 1) rank = 1;
+
+	for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			unsigned long long limit = __bucket_limit(i);
+
+			if (limit > h->max) limit = h->max;
+			if (limit < h->min) limit = h->min;
+			return limit;
+		}
+	}
+	return h->max;
+}
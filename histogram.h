@@ -0,0 +1,62 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+/**
+ * Histogram of non-negative integers in fixed log-linear buckets. Values
+ * below 16 have their own buckets, and each power of two above is split
+ * into 16 buckets. Thus percentiles are within 1/16 of the real values,
+ * and adding a value neither allocates nor depends on the number of values.
+ */
+#define HISTOGRAM_SUB_BITS	4
+#define HISTOGRAM_SUBS		(1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS	((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUBS)
+
+struct histogram {
+	unsigned long long nr;		/* # of values added */
+	unsigned long long sum;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long long buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_init(struct histogram *h);
+
+/***********************************************************************
+ * histogram_add()
+ *
+ * DESCRIPTION
+ *   Count @value into @h.
+ */
+void histogram_add(struct histogram *h, unsigned long long value);
+
+/***********************************************************************
+ * histogram_percentile()
+ *
+ * DESCRIPTION
+ *   The value that @percent % of the values in @h are less than or equal to.
+ *   It is the upper bound of the bucket the value falls into, but never
+ *   exceeds the maximum. 0 if @h is empty.
+ */
+unsigned long long histogram_percentile(const struct histogram *h, double percent);
+
+static inline double histogram_mean(const struct histogram *h)
+{
+	return h->nr ? (double)h->sum / h->nr : 0;
+}
+
+#endif
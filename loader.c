@@ -0,0 +1,1278 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/*====================================================================*/
+/*          ******        DO NOT MODIFY THIS FILE        ******       */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "types.h"
+#include "list_head.h"
+
+#include "parser.h"
+#include "process.h"
+#include "resource.h"
+
+#include "sim.h"
+#include "workload.h"
+#include "thread_pool.h"
+
+/**
+ * The whole file mapped into memory. Files that cannot be mapped, such as
+ * pipes, are read into a buffer instead
+ */
+struct script_map {
+	char *data;
+	size_t size;
+	bool mapped;
+};
+
+/**
+ * State of parsing a process script
+ */
+struct script_parser {
+	struct process *p;		/* The process being described */
+	unsigned int line;		/* # of lines parsed so far */
+
+	/* Pools to allocate the processes and their schedules from */
+	struct pool *processes;
+	struct pool *schedules;
+
+	int max_resource_id;	/* The largest resource id of the completed ones */
+	bool silent;			/* Fail without complaining */
+};
+
+#define __complain(parser, ...) \
+	do { if (!(parser)->silent) fprintf(stderr, __VA_ARGS__); } while (0)
+
+/**
+ * Processes described in [@begin, @end) of the script, in the script order
+ */
+struct script_chunk {
+	const char *begin;
+	const char *end;
+	struct script_parser parser;
+	bool sort;				/* Sort the schedules of the processes here */
+
+	struct list_head forkqueue;
+	unsigned int nr_forkqueue;
+	bool sorted;			/* @forkqueue is sorted by the start ticks */
+	bool failed;
+
+	/* Per-chunk arenas when chunks are parsed in parallel */
+	struct pool processes;
+	struct pool schedules;
+};
+
+/**
+ * Parse the script in chunks of this many bytes at least on worker threads
+ */
+#define PARALLEL_CHUNK_SIZE	(4 << 20)
+
+/**
+ * Where the processes of a simulation come from
+ */
+struct sim_loader {
+	/**
+	 * Compiled workload being simulated. See workload.h
+	 */
+	struct {
+		struct script_map map;
+		const struct workload_process *processes;
+		const struct workload_schedule *schedules;
+		uint32_t nr_processes;
+		uint64_t nr_schedules;
+		uint32_t next;
+	} workload;
+
+	/**
+	 * Script being streamed. Process descriptions are read only as far as
+	 * the simulation needs, so they should be sorted by their start ticks
+	 */
+	struct {
+		int fd;
+		char *buffer;
+		size_t size;
+		size_t begin;			/* Unparsed data is in [@begin, @end) */
+		size_t end;
+		bool eof;
+		struct script_parser parser;
+		unsigned int last_start;
+	} stream;
+};
+
+static struct sim_loader *__get_loader(struct sim_context *sim)
+{
+	if (!sim->__loader) {
+		sim->__loader = calloc(1, sizeof(*sim->__loader));
+		if (!sim->__loader) {
+			fprintf(stderr, "Out of memory while loading the script\n");
+			return NULL;
+		}
+		sim->__loader->stream.fd = -1;
+	}
+	return sim->__loader;
+}
+
+static void __briefing_process(struct sim_context *sim, struct process *p)
+{
+	struct resource_schedule *rs;
+
+	if (sim->options.quiet) return;
+
+	printf("- Process %d: Forked at tick %d and run for %d tick%s with initial priority %d\n",
+				p->pid, p->__starts_at, p->lifespan,
+				p->lifespan >= 2 ? "s" : "", p->prio);
+
+	list_for_each_entry(rs, &p->__resources_to_acquire, list) {
+		printf("    Acquire resource %d at %d for %d\n", rs->resource_id, rs->at, rs->duration);
+	}
+}
+
+/**
+ * Sort the schedule of @p to acquire resources by the ages to acquire at,
+ * in the script order among the ties, so that the framework only looks at
+ * its head. Scripts list them mostly in order, so insert each from the tail
+ */
+static void __sort_schedule(struct process *p)
+{
+	struct resource_schedule *rs, *tmp;
+	LIST_HEAD(sorted);
+
+	list_for_each_entry_safe(rs, tmp, &p->__resources_to_acquire, list) {
+		struct list_head *pos = sorted.prev;
+
+		while (pos != &sorted &&
+				list_entry(pos, struct resource_schedule, list)->at > rs->at) {
+			pos = pos->prev;
+		}
+		list_move(&rs->list, pos);
+	}
+	list_splice(&sorted, &p->__resources_to_acquire);
+}
+
+/**
+ * Stable merge sort of @nr processes in @head by their start ticks
+ */
+static void __sort_by_start(struct list_head *head, unsigned int nr)
+{
+	LIST_HEAD(left);
+	struct list_head *pos = head;
+
+	if (nr < 2) return;
+
+	for (unsigned int i = 0; i < nr / 2; i++) {
+		pos = pos->next;
+	}
+	list_cut_position(&left, head, pos);
+
+	__sort_by_start(&left, nr / 2);
+	__sort_by_start(head, nr - nr / 2);
+
+	/* Merge @left into @head. Entries in @left go first on the tie */
+	pos = head->next;
+	while (!list_empty(&left)) {
+		struct process *l = list_first_entry(&left, struct process, list);
+
+		if (pos == head ||
+				l->__starts_at <= list_entry(pos, struct process, list)->__starts_at) {
+			list_move_tail(&l->list, pos);
+		} else {
+			pos = pos->next;
+		}
+	}
+}
+
+/**
+ * Keywords in the process script
+ */
+enum keyword {
+	KEYWORD_UNKNOWN,
+	KEYWORD_PROCESS,
+	KEYWORD_END,
+	KEYWORD_START,
+	KEYWORD_LIFESPAN,
+	KEYWORD_PRIO,
+	KEYWORD_ACQUIRE,
+};
+
+/**
+ * Identify the keyword by the token length (and the first letter for the
+ * 7-letter ones), and then confirm it with one memcmp()
+ */
+static inline enum keyword __keyword(const struct token *token)
+{
+	const char *expect;
+	enum keyword keyword;
+
+	switch (token->len) {
+	case 3:
+		expect = "end"; keyword = KEYWORD_END;
+		break;
+	case 4:
+		expect = "prio"; keyword = KEYWORD_PRIO;
+		break;
+	case 5:
+		expect = "start"; keyword = KEYWORD_START;
+		break;
+	case 7:
+		if (token->str[0] == 'p') {
+			expect = "process"; keyword = KEYWORD_PROCESS;
+		} else {
+			expect = "acquire"; keyword = KEYWORD_ACQUIRE;
+		}
+		break;
+	case 8:
+		expect = "lifespan"; keyword = KEYWORD_LIFESPAN;
+		break;
+	default:
+		return KEYWORD_UNKNOWN;
+	}
+
+	return memcmp(token->str, expect, token->len) == 0 ? keyword : KEYWORD_UNKNOWN;
+}
+
+/**
+ * Get the integer in @token into @value, or complain and return false
+ */
+static bool __parse_value(struct script_parser *parser,
+		const struct token *token, int *value)
+{
+	if (parse_int(token, value)) return true;
+
+	__complain(parser, "Invalid number %.*s at line %u\n",
+			(int)token->len, token->str, parser->line);
+	return false;
+}
+
+static void __init_parser(struct script_parser *parser,
+		struct pool *processes, struct pool *schedules)
+{
+	parser->p = NULL;
+	parser->line = 0;
+	parser->processes = processes;
+	parser->schedules = schedules;
+	parser->max_resource_id = -1;
+	parser->silent = false;
+}
+
+/**
+ * Make the resource table of @sim cover the resources that @p will acquire
+ */
+static bool __reserve_resources_of(struct sim_context *sim, struct process *p)
+{
+	struct resource_schedule *rs;
+	int max_id = -1;
+
+	list_for_each_entry(rs, &p->__resources_to_acquire, list) {
+		if (rs->resource_id > max_id) max_id = rs->resource_id;
+	}
+	return __sim_reserve_resources(sim, max_id + 1);
+}
+
+/**
+ * Likewise, for all the processes completed by @parser
+ */
+static bool __reserve_parsed_resources(struct sim_context *sim,
+		const struct script_parser *parser)
+{
+	if (__sim_reserve_resources(sim, parser->max_resource_id + 1)) return true;
+
+	fprintf(stderr, "Out of memory while loading process\n");
+	return false;
+}
+
+/**
+ * Parse a line of the script in @tokens. Put the process into @*done when
+ * its description is completed.
+ *
+ * RETURN
+ *   1 if @*done is set
+ *   0 if the line is parsed but the process is not completed yet
+ *   -1 on error
+ */
+static int __parse_line(struct script_parser *parser,
+		const struct token *tokens, int nr_tokens, struct process **done)
+{
+	struct process *p = parser->p;
+	enum keyword keyword;
+	int value;
+
+	if (nr_tokens == 0) return 0;
+	assert(nr_tokens <= MAX_NR_TOKENS);
+
+	keyword = __keyword(tokens);
+	if (!p && keyword != KEYWORD_PROCESS && keyword != KEYWORD_UNKNOWN) {
+		__complain(parser, "Property %.*s outside process at line %u\n",
+				(int)tokens[0].len, tokens[0].str, parser->line);
+		return -1;
+	}
+
+	switch (keyword) {
+	case KEYWORD_PROCESS:
+		assert(nr_tokens == 2);
+		/* Start processor description */
+		p = pool_alloc(parser->processes);
+		if (!p) {
+			__complain(parser, "Out of memory while loading process\n");
+			return -1;
+		}
+		memset(p, 0x00, sizeof(*p));
+
+		if (!__parse_value(parser, tokens + 1, &value)) return -1;
+		p->pid = value;
+
+		INIT_LIST_HEAD(&p->list);
+		INIT_LIST_HEAD(&p->__resources_to_acquire);
+		INIT_LIST_HEAD(&p->__resources_holding);
+
+		parser->p = p;
+		break;
+
+	case KEYWORD_END: {
+		struct resource_schedule *rs;
+
+		/* End of process description */
+		list_for_each_entry(rs, &p->__resources_to_acquire, list) {
+			if (rs->resource_id > parser->max_resource_id) {
+				parser->max_resource_id = rs->resource_id;
+			}
+		}
+
+		*done = p;
+		parser->p = NULL;
+		return 1;
+	}
+
+	case KEYWORD_LIFESPAN:
+		assert(nr_tokens == 2);
+		if (!__parse_value(parser, tokens + 1, &value)) return -1;
+		if (value < 1) {
+			__complain(parser, "Lifespan %d out of range 1..%d at line %u\n",
+					value, INT_MAX, parser->line);
+			return -1;
+		}
+		p->lifespan = value;
+		break;
+
+	case KEYWORD_PRIO:
+		assert(nr_tokens == 2);
+		if (!__parse_value(parser, tokens + 1, &value)) return -1;
+		if (value < 0 || value > MAX_PRIO) {
+			__complain(parser, "Prio %d out of range 0..%d at line %u\n",
+					value, MAX_PRIO, parser->line);
+			return -1;
+		}
+		p->prio = p->prio_orig = value;
+		break;
+
+	case KEYWORD_START:
+		assert(nr_tokens == 2);
+		if (!__parse_value(parser, tokens + 1, &value)) return -1;
+		p->__starts_at = value;
+		break;
+
+	case KEYWORD_ACQUIRE: {
+		struct resource_schedule *rs;
+		assert(nr_tokens == 4);
+
+		rs = pool_alloc(parser->schedules);
+		if (!rs) {
+			__complain(parser, "Out of memory while loading process\n");
+			return -1;
+		}
+
+		if (!__parse_value(parser, tokens + 1, &rs->resource_id) ||
+				!__parse_value(parser, tokens + 2, &rs->at) ||
+				!__parse_value(parser, tokens + 3, &rs->duration)) {
+			return -1;
+		}
+		if (rs->resource_id < 0 || rs->resource_id >= MAX_RESOURCES) {
+			__complain(parser, "Invalid resource %d at line %u\n",
+					rs->resource_id, parser->line);
+			return -1;
+		}
+		if (rs->at < 0 || rs->duration < 1) {
+			__complain(parser, "Invalid schedule to acquire at %d for %d at line %u\n",
+					rs->at, rs->duration, parser->line);
+			return -1;
+		}
+
+		list_add_tail(&rs->list, &p->__resources_to_acquire);
+		break;
+	}
+
+	default:
+		__complain(parser, "Unknown property %.*s\n",
+				(int)tokens[0].len, tokens[0].str);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void __init_chunk(struct script_chunk *chunk,
+		const char *begin, const char *end)
+{
+	chunk->begin = begin;
+	chunk->end = end;
+	chunk->sort = true;
+	INIT_LIST_HEAD(&chunk->forkqueue);
+	chunk->nr_forkqueue = 0;
+	chunk->sorted = true;
+	chunk->failed = false;
+}
+
+/**
+ * Parse the process descriptions in the chunk into its @forkqueue. This
+ * only touches @chunk, so chunks with their own pools can be parsed on
+ * different threads
+ */
+static bool __parse_chunk(struct script_chunk *chunk)
+{
+	const char *pos = chunk->begin;
+
+	while (pos < chunk->end) {
+		struct token tokens[MAX_NR_TOKENS];
+		struct process *p;
+		int nr_tokens;
+		int ret;
+
+		nr_tokens = scan_tokens(&pos, chunk->end, tokens, MAX_NR_TOKENS);
+		chunk->parser.line++;
+
+		ret = __parse_line(&chunk->parser, tokens, nr_tokens, &p);
+		if (ret < 0) {
+			chunk->failed = true;
+			return false;
+		}
+		if (ret == 0) continue;
+
+		if (!list_empty(&chunk->forkqueue) &&
+				list_last_entry(&chunk->forkqueue, struct process, list)->__starts_at > p->__starts_at) {
+			chunk->sorted = false;
+		}
+		list_add_tail(&p->list, &chunk->forkqueue);
+		chunk->nr_forkqueue++;
+
+		if (chunk->sort) __sort_schedule(p);
+	}
+
+	return true;
+}
+
+static void __parse_chunk_job(void *arg, unsigned int i)
+{
+	__parse_chunk((struct script_chunk *)arg + i);
+}
+
+/**
+ * Append the processes parsed in @chunk to @sim->__forkqueue
+ */
+static bool __merge_chunk(struct sim_context *sim, struct script_chunk *chunk)
+{
+	struct process *p;
+
+	if (!__reserve_parsed_resources(sim, &chunk->parser)) return false;
+
+	if (!chunk->sorted || (!list_empty(&sim->__forkqueue) &&
+			!list_empty(&chunk->forkqueue) &&
+			list_last_entry(&sim->__forkqueue, struct process, list)->__starts_at >
+			list_first_entry(&chunk->forkqueue, struct process, list)->__starts_at)) {
+		sim->__forkqueue_sorted = false;
+	}
+
+	/* The briefing lists the schedules in the script order */
+	list_for_each_entry(p, &chunk->forkqueue, list) {
+		__briefing_process(sim, p);
+		if (!chunk->sort) __sort_schedule(p);
+	}
+
+	list_splice_tail_init(&chunk->forkqueue, &sim->__forkqueue);
+	sim->__nr_forkqueue += chunk->nr_forkqueue;
+	return true;
+}
+
+/**
+ * Parse the process descriptions in [@pos, @end) and put the processes
+ * into @sim->__forkqueue
+ */
+static int __parse_script(struct sim_context *sim,
+		const char *pos, const char * const end)
+{
+	struct script_chunk chunk;
+
+	__init_chunk(&chunk, pos, end);
+	__init_parser(&chunk.parser, &sim->__process_pool,
+			&sim->__resource_schedule_pool);
+	chunk.sort = sim->options.quiet;
+
+	if (!__parse_chunk(&chunk)) return false;
+
+	return __merge_chunk(sim, &chunk);
+}
+
+/**
+ * The beginning of the first line at or after @pos that starts a process
+ * description, or @end if there is none
+ */
+static const char *__next_process(const char *pos, const char *end)
+{
+	while (pos < end) {
+		const char *line = pos;
+		struct token token;
+
+		if (scan_tokens(&pos, end, &token, 1) && __keyword(&token) == KEYWORD_PROCESS) {
+			return line;
+		}
+	}
+	return end;
+}
+
+/**
+ * Split [@pos, @end) into chunks at the process descriptions, and parse
+ * them on worker threads into their own pools. The chunks are merged in
+ * the script order, so the result is the same as __parse_script(). As the
+ * workers do not complain, the script is parsed again by __parse_script()
+ * for the diagnostics if any chunk fails.
+ */
+static int __parse_script_parallel(struct sim_context *sim,
+		const char *pos, const char * const end)
+{
+	size_t size = end - pos;
+	unsigned int nr_chunks = sim->options.nr_threads ?
+			sim->options.nr_threads : thread_pool_nr_cpus();
+	const char *begin = pos;
+	struct script_chunk *chunks;
+	bool invalid = false, failed = false;
+	unsigned int i;
+
+	if (nr_chunks > size / PARALLEL_CHUNK_SIZE) {
+		nr_chunks = size / PARALLEL_CHUNK_SIZE;
+	}
+	if (nr_chunks < 2) return __parse_script(sim, pos, end);
+
+	chunks = malloc(sizeof(*chunks) * nr_chunks);
+	if (!chunks) return __parse_script(sim, pos, end);
+
+	for (i = 0; i < nr_chunks; i++) {
+		struct script_chunk *chunk = chunks + i;
+		const char *chunk_end = end;
+
+		if (i < nr_chunks - 1) {
+			const char *split = pos + (end - pos) / (nr_chunks - i);
+			const char *newline = memchr(split, '\n', end - split);
+
+			chunk_end = newline ? __next_process(newline + 1, end) : end;
+		}
+
+		__init_chunk(chunk, pos, chunk_end);
+		chunk->sort = sim->options.quiet;
+
+		pool_init(&chunk->processes, "process", sizeof(struct process));
+		pool_init(&chunk->schedules, "resource_schedule",
+				sizeof(struct resource_schedule));
+		__init_parser(&chunk->parser, &chunk->processes, &chunk->schedules);
+		chunk->parser.silent = true;
+
+		pos = chunk_end;
+	}
+
+	thread_pool_run(nr_chunks, nr_chunks, __parse_chunk_job, chunks);
+
+	for (i = 0; i < nr_chunks; i++) {
+		if (chunks[i].failed) invalid = true;
+	}
+
+	for (i = 0; i < nr_chunks; i++) {
+		struct script_chunk *chunk = chunks + i;
+
+		if (!invalid && !failed) {
+			failed = !__merge_chunk(sim, chunk);
+			pool_merge(&sim->__process_pool, &chunk->processes);
+			pool_merge(&sim->__resource_schedule_pool, &chunk->schedules);
+		}
+		pool_destroy(&chunk->processes);
+		pool_destroy(&chunk->schedules);
+	}
+	free(chunks);
+
+	if (invalid) return __parse_script(sim, begin, end);
+	return !failed;
+}
+
+/**
+ * Open @filename to read. "-" stands for the standard input
+ */
+static int __open_script(const char *filename)
+{
+	if (strcmp(filename, "-") == 0) {
+		return dup(STDIN_FILENO);
+	}
+	return open(filename, O_RDONLY);
+}
+
+static int __map_script(const char *filename, struct script_map *map)
+{
+	struct stat st;
+	int fd = __open_script(filename);
+	size_t capacity;
+
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return -1;
+	}
+
+	map->data = NULL;
+	map->size = 0;
+	map->mapped = false;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		if (st.st_size == 0) goto out;
+
+		map->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map->data != MAP_FAILED) {
+			map->size = st.st_size;
+			map->mapped = true;
+			goto out;
+		}
+		map->data = NULL;
+	}
+
+	capacity = 1 << 16;
+	while (true) {
+		ssize_t ret;
+
+		if (!map->data || map->size == capacity) {
+			char *data = realloc(map->data, capacity *= 2);
+			if (!data) goto error;
+			map->data = data;
+		}
+
+		ret = read(fd, map->data + map->size, capacity - map->size);
+		if (ret < 0) goto error;
+		if (ret == 0) break;
+		map->size += ret;
+	}
+
+out:
+	close(fd);
+	return 0;
+
+error:
+	fprintf(stderr, "Cannot read %s\n", filename);
+	free(map->data);
+	close(fd);
+	return -1;
+}
+
+static void __unmap_script(struct script_map *map)
+{
+	if (map->mapped) {
+		munmap(map->data, map->size);
+	} else {
+		free(map->data);
+	}
+	map->data = NULL;
+}
+
+static void __briefing_record(struct sim_loader *loader,
+		const struct workload_process *wp)
+{
+	const struct workload_schedule *ws = loader->workload.schedules + wp->first_schedule;
+
+	printf("- Process %d: Forked at tick %d and run for %d tick%s with initial priority %d\n",
+				wp->pid, wp->starts_at, wp->lifespan,
+				wp->lifespan >= 2 ? "s" : "", wp->prio);
+
+	for (uint32_t i = 0; i < wp->nr_schedules; i++, ws++) {
+		printf("    Acquire resource %d at %d for %d\n", ws->resource_id, ws->at, ws->duration);
+	}
+}
+
+/**
+ * Build the next process from the compiled workload
+ */
+static struct process *__pull_workload_process(struct sim_context *sim)
+{
+	struct sim_loader *loader = sim->__loader;
+	const struct workload_process *wp;
+	const struct workload_schedule *ws;
+	struct process *p;
+
+	if (loader->workload.next == loader->workload.nr_processes) return NULL;
+
+	wp = loader->workload.processes + loader->workload.next++;
+	if (wp->first_schedule > loader->workload.nr_schedules ||
+			wp->nr_schedules > loader->workload.nr_schedules - wp->first_schedule) {
+		trace_flush(&sim->__trace);
+		fprintf(stderr, "Corrupted workload record %u\n", loader->workload.next - 1);
+		exit(EXIT_FAILURE);
+	}
+
+	if (wp->prio > MAX_PRIO || wp->lifespan < 1 || wp->lifespan > INT_MAX) {
+		trace_flush(&sim->__trace);
+		fprintf(stderr, "Corrupted workload record %u\n", loader->workload.next - 1);
+		exit(EXIT_FAILURE);
+	}
+
+	p = pool_alloc(&sim->__process_pool);
+	if (!p) goto out_of_memory;
+	memset(p, 0x00, sizeof(*p));
+
+	p->pid = wp->pid;
+	p->__starts_at = wp->starts_at;
+	p->lifespan = wp->lifespan;
+	p->prio = p->prio_orig = wp->prio;
+
+	INIT_LIST_HEAD(&p->list);
+	INIT_LIST_HEAD(&p->__resources_to_acquire);
+	INIT_LIST_HEAD(&p->__resources_holding);
+
+	ws = loader->workload.schedules + wp->first_schedule;
+	for (uint32_t i = 0; i < wp->nr_schedules; i++, ws++) {
+		struct resource_schedule *rs = pool_alloc(&sim->__resource_schedule_pool);
+		if (!rs) goto out_of_memory;
+
+		if (ws->resource_id < 0 || ws->resource_id >= MAX_RESOURCES ||
+				ws->at < 0 || ws->duration < 1) {
+			trace_flush(&sim->__trace);
+			fprintf(stderr, "Corrupted workload record %u\n", loader->workload.next - 1);
+			exit(EXIT_FAILURE);
+		}
+
+		rs->resource_id = ws->resource_id;
+		rs->at = ws->at;
+		rs->duration = ws->duration;
+		list_add_tail(&rs->list, &p->__resources_to_acquire);
+	}
+
+	if (!__reserve_resources_of(sim, p)) goto out_of_memory;
+	__sort_schedule(p);
+
+	return p;
+
+out_of_memory:
+	trace_flush(&sim->__trace);
+	fprintf(stderr, "Out of memory while loading process\n");
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * Simulate the compiled workload in @map. The processes are built lazily
+ * while the simulation goes on
+ */
+static int __load_workload(struct sim_context *sim, struct script_map *map)
+{
+	const struct workload_header *header = (void *)map->data;
+	struct sim_loader *loader;
+
+	if (map->size < sizeof(*header) || header->version != WORKLOAD_VERSION ||
+			header->processes_offset > map->size ||
+			(map->size - header->processes_offset) / sizeof(struct workload_process) <
+				header->nr_processes ||
+			header->schedules_offset > map->size ||
+			(map->size - header->schedules_offset) / sizeof(struct workload_schedule) <
+				header->nr_schedules ||
+			header->processes_offset % sizeof(uint64_t) ||
+			header->schedules_offset % sizeof(uint32_t)) {
+		fprintf(stderr, "Invalid workload file\n");
+		return false;
+	}
+
+	if (!(loader = __get_loader(sim))) return false;
+
+	loader->workload.map = *map;
+	loader->workload.processes = (void *)(map->data + header->processes_offset);
+	loader->workload.schedules = (void *)(map->data + header->schedules_offset);
+	loader->workload.nr_processes = header->nr_processes;
+	loader->workload.nr_schedules = header->nr_schedules;
+	loader->workload.next = 0;
+
+	if (!sim->options.quiet) {
+		for (uint32_t i = 0; i < loader->workload.nr_processes; i++) {
+			const struct workload_process *wp = loader->workload.processes + i;
+
+			if (wp->first_schedule > loader->workload.nr_schedules ||
+					wp->nr_schedules >
+						loader->workload.nr_schedules - wp->first_schedule) {
+				continue;
+			}
+			__briefing_record(loader, wp);
+		}
+		printf("\n");
+	}
+
+	sim->__pull_process = __pull_workload_process;
+	return true;
+}
+
+/**
+ * Load all processes that are not pulled yet into @sim->__forkqueue
+ */
+void __sim_pull_all(struct sim_context *sim)
+{
+	struct process *p;
+
+	/* Loaded already. Replicas may be made on other threads then */
+	if (!sim->__pull_process) return;
+
+	while (sim->__pull_process && (p = sim->__pull_process(sim))) {
+		list_add_tail(&p->list, &sim->__forkqueue);
+		sim->__nr_forkqueue++;
+	}
+	sim->__pull_process = NULL;
+}
+
+bool sim_compile(struct sim_context *sim, const char *filename)
+{
+	struct workload_header header = {
+		.magic = WORKLOAD_MAGIC,
+		.version = WORKLOAD_VERSION,
+	};
+	struct process *p;
+	struct resource_schedule *rs;
+	char path[PATH_MAX];
+	FILE *file;
+	bool failed = false;
+
+	/* Recompiling a compiled workload. Load all of them */
+	__sim_pull_all(sim);
+
+	/* Write to a temporary file, and replace the workload at once */
+	snprintf(path, sizeof(path), "%s.tmp", filename);
+	file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return false;
+	}
+
+	list_for_each_entry(p, &sim->__forkqueue, list) {
+		header.nr_processes++;
+		list_for_each_entry(rs, &p->__resources_to_acquire, list) {
+			header.nr_schedules++;
+		}
+	}
+	header.processes_offset = sizeof(header);
+	header.schedules_offset = header.processes_offset +
+			(uint64_t)header.nr_processes * sizeof(struct workload_process);
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1) failed = true;
+
+	header.nr_schedules = 0;
+	list_for_each_entry(p, &sim->__forkqueue, list) {
+		struct workload_process wp = {
+			.pid = p->pid,
+			.starts_at = p->__starts_at,
+			.lifespan = p->lifespan,
+			.prio = p->prio_orig,
+			.first_schedule = header.nr_schedules,
+		};
+
+		list_for_each_entry(rs, &p->__resources_to_acquire, list) {
+			wp.nr_schedules++;
+		}
+		header.nr_schedules += wp.nr_schedules;
+
+		if (fwrite(&wp, sizeof(wp), 1, file) != 1) failed = true;
+	}
+
+	list_for_each_entry(p, &sim->__forkqueue, list) {
+		list_for_each_entry(rs, &p->__resources_to_acquire, list) {
+			struct workload_schedule ws = {
+				.resource_id = rs->resource_id,
+				.at = rs->at,
+				.duration = rs->duration,
+			};
+			if (fwrite(&ws, sizeof(ws), 1, file) != 1) failed = true;
+		}
+	}
+
+	if (ferror(file)) failed = true;
+	if (fclose(file)) failed = true;
+
+	if (failed || rename(path, filename)) {
+		fprintf(stderr, "Cannot write %s\n", filename);
+		unlink(path);
+		return false;
+	}
+
+	printf("Compiled %u processes and %llu resource schedules into %s\n",
+			header.nr_processes,
+			(unsigned long long)header.nr_schedules, filename);
+	return true;
+}
+
+struct sim_context *sim_clone(struct sim_context *sim,
+		const struct scheduler *sched, const struct sim_options *options)
+{
+	struct sim_context *clone;
+	struct process *p;
+
+	assert(sim->ticks == 0 && !sim->cpus[0].current);
+
+	/* Share the processes being streamed or built from a workload as well */
+	__sim_pull_all(sim);
+
+	clone = sim_create(sched, options);
+	if (!clone) return NULL;
+
+	if (!__sim_reserve_resources(clone, sim->nr_resources)) goto out_of_memory;
+
+	list_for_each_entry(p, &sim->__forkqueue, list) {
+		struct process *q = pool_alloc(&clone->__process_pool);
+		struct resource_schedule *rs;
+
+		if (!q) goto out_of_memory;
+
+		*q = *p;
+		INIT_LIST_HEAD(&q->__resources_to_acquire);
+		INIT_LIST_HEAD(&q->__resources_holding);
+
+		list_for_each_entry(rs, &p->__resources_to_acquire, list) {
+			struct resource_schedule *qs = pool_alloc(&clone->__resource_schedule_pool);
+
+			if (!qs) goto out_of_memory;
+
+			*qs = *rs;
+			list_add_tail(&qs->list, &q->__resources_to_acquire);
+		}
+
+		list_add_tail(&q->list, &clone->__forkqueue);
+		clone->__nr_forkqueue++;
+	}
+
+	return clone;
+
+out_of_memory:
+	fprintf(stderr, "Out of memory while cloning the simulation\n");
+	sim_destroy(clone);
+	return NULL;
+}
+
+/**
+ * splitmix64 as in scriptgen, over the state of a replica
+ */
+static unsigned long long __next_random(unsigned long long *state)
+{
+	unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Move @value by up to @jitter either way at random, but not below @min
+ */
+static int __jitter(unsigned long long *state, int value, unsigned int jitter,
+		int min)
+{
+	long long moved;
+
+	if (!jitter) return value;
+
+	moved = (long long)value - jitter +
+			(long long)(__next_random(state) % (2ULL * jitter + 1));
+	if (moved < min) return min;
+	if (moved > INT_MAX) return INT_MAX;
+	return moved;
+}
+
+/**
+ * Jitter the ages of @p to acquire resources at, keeping the holds as they
+ * are in @base, the process @p is cloned from. The resources are acquired
+ * in the same order, and each hold released before an acquisition in @base
+ * is released before it as well. So @p never holds more while waiting for
+ * a resource than in @base, and in particular never waits for one it holds.
+ * The holds end within the lifespan, which stretches if they cannot.
+ */
+static void __jitter_schedule(unsigned long long *state, struct process *p,
+		const struct process *base, unsigned int jitter)
+{
+	struct resource_schedule *rs, *hs;
+	const struct resource_schedule *bs, *gs;
+	int after = 0;
+
+	bs = list_first_entry(&base->__resources_to_acquire,
+			struct resource_schedule, list);
+
+	list_for_each_entry(rs, &p->__resources_to_acquire, list) {
+		int at = __jitter(state, bs->at, jitter, 0);
+
+		/* @hs and @gs walk the holds before in @p and @base together */
+		gs = list_first_entry(&base->__resources_to_acquire,
+				struct resource_schedule, list);
+		list_for_each_entry(hs, &p->__resources_to_acquire, list) {
+			if (hs == rs) break;
+
+			if (gs->at + gs->duration <= bs->at &&
+					hs->at + hs->duration > after) {
+				after = hs->at + hs->duration;
+			}
+			gs = list_next_entry(gs, list);
+		}
+
+		if (at > (long long)p->lifespan - rs->duration) {
+			at = p->lifespan - rs->duration;
+		}
+		if (at < after) at = after;
+		if (at > INT_MAX - rs->duration) at = INT_MAX - rs->duration;
+
+		rs->at = after = at;
+		if (p->lifespan < rs->at + rs->duration) {
+			p->lifespan = rs->at + rs->duration;
+		}
+
+		bs = list_next_entry(bs, list);
+	}
+}
+
+struct sim_context *sim_replicate(struct sim_context *sim,
+		const struct scheduler *sched, const struct sim_options *options,
+		const struct sim_jitter *jitter, unsigned long long seed)
+{
+	struct sim_context *replica = sim_clone(sim, sched, options);
+	unsigned long long state = seed;
+	struct process *p, *b;
+
+	if (!replica) return NULL;
+
+	/**
+	 * Draw in the order of the base, so the seed alone makes the replica.
+	 * The clone keeps the order, so @b walks the base along with @p
+	 */
+	b = list_first_entry(&sim->__forkqueue, struct process, list);
+	list_for_each_entry(p, &replica->__forkqueue, list) {
+		p->__starts_at = __jitter(&state, p->__starts_at, jitter->start, 0);
+		p->lifespan = __jitter(&state, p->lifespan, jitter->lifespan, 1);
+		__jitter_schedule(&state, p, b, jitter->acquire);
+
+		b = list_next_entry(b, list);
+	}
+	if (jitter->start) {
+		__sort_by_start(&replica->__forkqueue, replica->__nr_forkqueue);
+	}
+
+	return replica;
+}
+
+/**
+ * Read more data into the stream buffer. It grows if a line does not fit
+ */
+static void __refill_stream(struct sim_context *sim)
+{
+	struct sim_loader *loader = sim->__loader;
+	ssize_t ret;
+
+	if (loader->stream.begin) {
+		memmove(loader->stream.buffer, loader->stream.buffer + loader->stream.begin,
+				loader->stream.end - loader->stream.begin);
+		loader->stream.end -= loader->stream.begin;
+		loader->stream.begin = 0;
+	}
+
+	if (loader->stream.end == loader->stream.size) {
+		char *buffer = realloc(loader->stream.buffer, loader->stream.size * 2);
+		if (!buffer) {
+			trace_flush(&sim->__trace);
+			fprintf(stderr, "Out of memory while streaming the script\n");
+			exit(EXIT_FAILURE);
+		}
+		loader->stream.buffer = buffer;
+		loader->stream.size *= 2;
+	}
+
+	do {
+		ret = read(loader->stream.fd, loader->stream.buffer + loader->stream.end,
+				loader->stream.size - loader->stream.end);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) {
+		trace_flush(&sim->__trace);
+		fprintf(stderr, "Cannot read the script\n");
+		exit(EXIT_FAILURE);
+	}
+	if (ret == 0) {
+		loader->stream.eof = true;
+	}
+	loader->stream.end += ret;
+}
+
+/**
+ * Parse lines from the stream until a process description is completed
+ */
+static struct process *__pull_stream_process(struct sim_context *sim)
+{
+	struct sim_loader *loader = sim->__loader;
+
+	while (true) {
+		struct token tokens[MAX_NR_TOKENS];
+		const char *begin = loader->stream.buffer + loader->stream.begin;
+		const char *end = loader->stream.buffer + loader->stream.end;
+		const char *line_end = memchr(begin, '\n', end - begin);
+		struct process *p;
+		int nr_tokens;
+		int ret;
+
+		if (!line_end) {
+			if (!loader->stream.eof) {
+				__refill_stream(sim);
+				continue;
+			}
+			if (begin == end) return NULL;
+			line_end = end;
+		} else {
+			line_end++;
+		}
+
+		nr_tokens = scan_tokens(&begin, line_end, tokens, MAX_NR_TOKENS);
+		loader->stream.begin = begin - loader->stream.buffer;
+		loader->stream.parser.line++;
+
+		ret = __parse_line(&loader->stream.parser, tokens, nr_tokens, &p);
+		if (ret < 0) {
+			trace_flush(&sim->__trace);
+			exit(EXIT_FAILURE);
+		}
+		if (ret == 0) continue;
+
+		if (!__reserve_parsed_resources(sim, &loader->stream.parser)) {
+			trace_flush(&sim->__trace);
+			exit(EXIT_FAILURE);
+		}
+
+		if (p->__starts_at < loader->stream.last_start) {
+			trace_flush(&sim->__trace);
+			fprintf(stderr, "Process %d starts before the previous one at line %u. "
+					"The streamed script should be sorted by start ticks\n",
+					p->pid, loader->stream.parser.line);
+			exit(EXIT_FAILURE);
+		}
+		loader->stream.last_start = p->__starts_at;
+
+		__briefing_process(sim, p);
+		__sort_schedule(p);
+		return p;
+	}
+}
+
+static void __close_stream(struct sim_loader *loader)
+{
+	if (loader->stream.fd >= 0) {
+		close(loader->stream.fd);
+		loader->stream.fd = -1;
+	}
+	free(loader->stream.buffer);
+	loader->stream.buffer = NULL;
+}
+
+static struct process *__pull_stream(struct sim_context *sim)
+{
+	struct process *p = __pull_stream_process(sim);
+
+	if (!p) __close_stream(sim->__loader);
+	return p;
+}
+
+bool sim_stream(struct sim_context *sim, const char *filename)
+{
+	struct sim_loader *loader = __get_loader(sim);
+
+	if (!loader) return false;
+
+	loader->stream.fd = __open_script(filename);
+	if (loader->stream.fd < 0) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return false;
+	}
+
+	loader->stream.size = 1 << 16;
+	loader->stream.buffer = malloc(loader->stream.size);
+	if (!loader->stream.buffer) {
+		fprintf(stderr, "Out of memory while streaming the script\n");
+		__close_stream(loader);
+		return false;
+	}
+	loader->stream.begin = loader->stream.end = 0;
+	loader->stream.eof = false;
+	__init_parser(&loader->stream.parser, &sim->__process_pool,
+			&sim->__resource_schedule_pool);
+
+	sim->__pull_process = __pull_stream;
+
+	if (!sim->options.quiet) printf("\n");
+	return true;
+}
+
+bool sim_load(struct sim_context *sim, const char *filename)
+{
+	struct script_map map;
+	int ret;
+
+	if (__map_script(filename, &map)) {
+		return false;
+	}
+
+	if (map.size >= sizeof(struct workload_header) &&
+			memcmp(map.data, WORKLOAD_MAGIC, sizeof(((struct workload_header *)0)->magic)) == 0) {
+		if (__load_workload(sim, &map)) return true;
+
+		__unmap_script(&map);
+		return false;
+	}
+
+	ret = __parse_script_parallel(sim, map.data, map.data + map.size);
+
+	__unmap_script(&map);
+
+	if (!ret) return false;
+
+	if (!sim->__forkqueue_sorted) {
+		__sort_by_start(&sim->__forkqueue, sim->__nr_forkqueue);
+		sim->__forkqueue_sorted = true;
+	}
+
+	if (!sim->options.quiet) printf("\n");
+	return true;
+}
+
+void __sim_unload(struct sim_context *sim)
+{
+	struct sim_loader *loader = sim->__loader;
+
+	if (!loader) return;
+
+	if (loader->workload.map.data) {
+		__unmap_script(&loader->workload.map);
+	}
+	__close_stream(loader);
+
+	free(loader);
+	sim->__loader = NULL;
+	sim->__pull_process = NULL;
+}
+/*          ******        DO NOT MODIFY THIS FILE        ******       */
+/*====================================================================*/
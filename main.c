@@ -0,0 +1,888 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/*====================================================================*/
+/*          ******        DO NOT MODIFY THIS FILE        ******       */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+
+#include "types.h"
+#include "sim.h"
+#include "thread_pool.h"
+
+/**
+ * Schedulers to select with the options. @tag names the trace of the
+ * scheduler in the sweep mode
+ */
+static const struct {
+	char opt;
+	const char *tag;
+	const struct scheduler *sched;
+} __schedulers[] = {
+	{ 'f', "fifo", &fifo_scheduler },
+	{ 's', "sjf", &sjf_scheduler },
+	{ 'S', "srtf", &srtf_scheduler },
+	{ 'r', "rr", &rr_scheduler },
+	{ 'p', "prio", &prio_scheduler },
+	{ 'c', "pcp", &pcp_scheduler },
+	{ 'i', "pip", &pip_scheduler },
+	{ 'v', "cfs", &cfs_scheduler },
+};
+#define NR_SCHEDULERS	(sizeof(__schedulers) / sizeof(__schedulers[0]))
+
+/**
+ * The scheduler to simulate unless selected otherwise. A specialized build
+ * (sched-<tag>, see the Makefile) simulates its own scheduler only.
+ */
+#ifdef SIM_SCHEDULER
+#define DEFAULT_SCHEDULER	(&SIM_SCHEDULER)
+#else
+#define DEFAULT_SCHEDULER	(&fifo_scheduler)
+#endif
+
+static int __find_scheduler(int opt)
+{
+	for (int i = 0; i < NR_SCHEDULERS; i++) {
+		if (__schedulers[i].opt == opt) return i;
+	}
+	return -1;
+}
+
+/**
+ * Schedulers to sweep when none is selected
+ */
+static unsigned int __available_schedulers(void)
+{
+#ifdef SIM_SCHEDULER
+	for (int i = 0; i < NR_SCHEDULERS; i++) {
+		if (__schedulers[i].sched == DEFAULT_SCHEDULER) return 1 << i;
+	}
+	return 0;
+#else
+	return (1 << NR_SCHEDULERS) - 1;
+#endif
+}
+
+/* Upper bounds of the processors to simulate and of the threads to run */
+#define MAX_NR_CPUS		1024
+#define MAX_NR_THREADS	1024
+
+/**
+ * Parse the decimal count in @str into @*value, which should be 1 .. @max
+ */
+static bool __parse_count(const char *str, unsigned int max, unsigned int *value)
+{
+	char *end;
+	long count;
+
+	errno = 0;
+	count = strtol(str, &end, 10);
+	if (errno || end == str || *end || count < 1 || count > max) return false;
+
+	*value = count;
+	return true;
+}
+
+static void __print_usage(char * const name)
+{
+	printf("Usage: %s {-q} {-F|-z} {-e} {-T} {-D} {-M} {-L} {-j threads} {-n cpus} {-Q ticks} {-m} {-x metrics file} {-E event log} {-K statuses} {-P} {-B} {-C snapshot {-I ticks}} -[f|s|S|r|p|c|i|v] [process script file]\n", name);
+	printf("       %s -R [snapshot] {options above} -[f|s|S|r|p|c|i|v]\n", name);
+	printf("       %s -o [workload file] [process script file]\n", name);
+	printf("       %s -W [trace prefix] {-j threads} {-F|-z} {-e} {-T} {-D} {-L} {-n cpus} {-Q ticks} {-E event log} -[fsSrpciv]... [process script file]\n", name);
+	printf("       %s -N [replicas] {-J start,lifespan,acquire} {-Y seed} {-j threads} {-q} {-F|-z} {-e} {-n cpus} {-Q ticks} -[f|s|S|r|p|c|i|v] [process script file]\n", name);
+	printf("       %s -G [trace file]\n", name);
+	printf("\n");
+	printf("  -q: Run quietly\n");
+	printf("  -F: Fast-forward idle periods to the next fork\n");
+	printf("  -z: Fast-forward and print repeated records as \"... xN\"\n");
+	printf("  -e: Run in the event-driven mode (implies -F). Only for a single processor\n");
+	printf("  -T: Print the trace without indentation, prefixing pids\n");
+	printf("  -D: Print the digest of the trace and of each process instead of the trace\n");
+	printf("  -G: Print the digest of the text trace in [trace file] as -D would\n");
+	printf("  -M: Report the live and peak objects in the memory pools\n");
+	printf("  -o: Compile the script into a workload file to simulate later\n");
+	printf("  -L: Stream the script sorted by start ticks instead of loading it all\n");
+	printf("  -n: Simulate the number of processors, printing the processor of each event\n");
+	printf("  -Q: Run each picked process for up to the ticks before scheduling again\n");
+	printf("  -m: Report the scheduling metrics at the end\n");
+	printf("  -x: Write the metrics of each process to [metrics file], in JSON if it\n");
+	printf("      ends with .json or in CSV otherwise. Suffixed with .<scheduler> in -W\n");
+	printf("  -E: Log the events into [event log] from a writer thread, in JSON Lines if\n");
+	printf("      it ends with .jsonl or in binary records otherwise. Suffixed as -x\n");
+	printf("  -K: Record the last [statuses] that dump_status() would print, and print\n");
+	printf("      them only at the end, on an assertion failure, or on a signal\n");
+	printf("  -P: Profile the scheduler callbacks, and report the costs at the end\n");
+	printf("  -B: Print the throughput of the simulation in a line of key=value pairs\n");
+	printf("  -C: Checkpoint the simulation into [snapshot] every -I ticks (1000 by default)\n");
+	printf("  -R: Go on simulating from [snapshot] with the selected scheduler. With -W,\n");
+	printf("      each scheduler goes on from the snapshot\n");
+	printf("  -W: Sweep the selected schedulers (all by default) in parallel, writing\n");
+	printf("      the trace of each to [trace prefix].<scheduler>\n");
+	printf("  -N: Simulate the replicas of the script perturbed by -J, each from its own\n");
+	printf("      seed (-Y, -Y + 1, ...) on -j threads, and report the means and the 95%%\n");
+	printf("      confidence intervals of the results. -N 1 simulates the replica of\n");
+	printf("      seed -Y alone as usual\n");
+	printf("  -J: Move the start ticks, the lifespans, and the ages to acquire resources\n");
+	printf("      at by up to the ticks either way at random in each replica\n");
+	printf("  -Y: Seed of the first replica (1 by default)\n");
+	printf("  -j: Number of threads to sweep, to replicate, and to parse large scripts\n");
+	printf("      with (the number of processors by default)\n");
+	printf("\n");
+	printf("  The script file can be - to read the standard input\n\n");
+	printf("  -f: Use FIFO scheduler (default)\n");
+	printf("  -s: Use SJF scheduler\n");
+	printf("  -S: Use SRTF scheduler\n");
+	printf("  -r: Use Round-robin scheduler\n");
+	printf("  -p: Use Priority scheduler\n");
+	printf("  -c: Use Priority with PCP scheduler\n");
+	printf("  -i: Use Priority with PIP scheduler\n");
+	printf("  -v: Use Completely Fair scheduler\n");
+	printf("\n");
+}
+
+
+/**
+ * A simulation in the sweep
+ */
+struct sweep_run {
+	int scheduler;				/* Index in __schedulers[] */
+	struct sim_context *sim;
+	double elapsed;				/* Wall-clock seconds to simulate */
+};
+
+static double __now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void __sweep_one(void *arg, unsigned int job)
+{
+	struct sweep_run *run = (struct sweep_run *)arg + job;
+	double begin = __now();
+
+	sim_run_until(run->sim, UINT_MAX);
+
+	run->elapsed = __now() - begin;
+}
+
+static void __print_summary(struct sweep_run *runs, unsigned int nr_runs)
+{
+	printf("%-42s %10s %9s %14s %12s %10s\n",
+			"Scheduler", "Ticks", "Processes",
+			"Avg turnaround", "Avg waiting", "Time (ms)");
+
+	for (unsigned int i = 0; i < nr_runs; i++) {
+		struct sim_context *sim = runs[i].sim;
+		unsigned long nr = sim->stats.nr_exited ? sim->stats.nr_exited : 1;
+
+		printf("%-42s %10u %9lu %14.2f %12.2f %10.2f\n",
+				sim->sched->name, sim->ticks, sim->stats.nr_exited,
+				(double)sim->stats.turnaround / nr,
+				(double)sim->stats.waiting / nr,
+				runs[i].elapsed * 1e3);
+	}
+}
+
+/**
+ * Load @scriptfile into a context that only holds the processes to clone
+ */
+static struct sim_context *__load_base(const char *scriptfile, bool streaming,
+		const struct sim_options *options)
+{
+	struct sim_options base_options = *options;
+	struct sim_context *base;
+	bool loaded;
+
+	base_options.quiet = true;
+	base_options.silent_status = true;
+	base_options.report_metrics = false;
+	base_options.metrics_file = NULL;
+	base_options.eventlog_file = NULL;
+	base_options.profile = false;
+	base_options.digest_trace = false;
+
+	base = sim_create(DEFAULT_SCHEDULER, &base_options);
+	if (!base) return NULL;
+
+	if (streaming) {
+		loaded = sim_stream(base, scriptfile);
+	} else {
+		loaded = sim_load(base, scriptfile);
+	}
+	if (!loaded) {
+		sim_destroy(base);
+		return NULL;
+	}
+	return base;
+}
+
+/**
+ * Load @scriptfile once, and simulate it with each scheduler in @selected
+ * on @nr_threads threads. If @restoring, @scriptfile is a snapshot for each
+ * scheduler to go on from. The trace of each goes to @prefix.<tag>
+ */
+static int __sweep(const char *scriptfile, bool streaming, bool restoring,
+		unsigned int selected, struct sim_options *options, const char *prefix,
+		unsigned int nr_threads)
+{
+	struct sim_options base_options = *options;
+	struct sweep_run runs[NR_SCHEDULERS];
+	unsigned int nr_runs = 0;
+	struct sim_context *base = NULL;
+	int ret = EXIT_FAILURE;
+
+	/* Only the summary goes to the console */
+	base_options.quiet = true;
+	base_options.silent_status = true;
+
+	if (!restoring) {
+		base = __load_base(scriptfile, streaming, options);
+		if (!base) return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < NR_SCHEDULERS; i++) {
+		char path[PATH_MAX];
+		char metrics_path[PATH_MAX];
+		char eventlog_path[PATH_MAX];
+
+		if (!(selected & (1 << i))) continue;
+
+		if (options->metrics_file) {
+			snprintf(metrics_path, sizeof(metrics_path), "%s.%s",
+					options->metrics_file, __schedulers[i].tag);
+			base_options.metrics_file = metrics_path;
+		}
+		if (options->eventlog_file) {
+			snprintf(eventlog_path, sizeof(eventlog_path), "%s.%s",
+					options->eventlog_file, __schedulers[i].tag);
+			base_options.eventlog_file = eventlog_path;
+		}
+
+		snprintf(path, sizeof(path), "%s.%s", prefix, __schedulers[i].tag);
+		base_options.trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (base_options.trace_fd < 0) {
+			fprintf(stderr, "Cannot open %s\n", path);
+			goto out;
+		}
+
+		runs[nr_runs].scheduler = i;
+		if (restoring) {
+			runs[nr_runs].sim = sim_restore(scriptfile, __schedulers[i].sched, &base_options);
+		} else {
+			runs[nr_runs].sim = sim_clone(base, __schedulers[i].sched, &base_options);
+		}
+		if (!runs[nr_runs].sim) {
+			close(base_options.trace_fd);
+			goto out;
+		}
+		nr_runs++;
+	}
+
+	if (!options->quiet) {
+		printf("Sweeping %u scheduler%s over %s with %u thread%s\n\n",
+				nr_runs, nr_runs >= 2 ? "s" : "", scriptfile,
+				nr_threads, nr_threads >= 2 ? "s" : "");
+	}
+
+	thread_pool_run(nr_threads, nr_runs, __sweep_one, runs);
+
+	__print_summary(runs, nr_runs);
+	ret = EXIT_SUCCESS;
+
+out:
+	for (unsigned int i = 0; i < nr_runs; i++) {
+		int fd = runs[i].sim->options.trace_fd;
+
+		if (!sim_destroy(runs[i].sim)) ret = EXIT_FAILURE;
+		close(fd);
+	}
+	if (base) sim_destroy(base);
+	return ret;
+}
+
+
+/**
+ * A replica of the script, and its results
+ */
+struct replica_run {
+	unsigned long long seed;
+	struct sim_context *sim;	/* Until it is simulated */
+	unsigned int ticks;
+	unsigned long nr_exited;
+	unsigned long nr_unfinished;
+								/* # of processes left not exited */
+	double turnaround;			/* Average over the processes */
+	double waiting;
+	double *metrics;			/* Mean, p50 and p99 of each histogram */
+	bool failed;
+};
+
+/* Statistics of the histograms of the metrics to aggregate */
+static const struct {
+	const char *name;
+	double percent;				/* Percentile, or 0 for the mean */
+} __replica_stats[] = {
+	{ "mean", 0 },
+	{ "p50", 50 },
+	{ "p99", 99 },
+};
+#define NR_REPLICA_STATS	(sizeof(__replica_stats) / sizeof(__replica_stats[0]))
+
+struct replica_set {
+	struct sim_context *base;
+	const struct scheduler *sched;
+	struct sim_options options;
+	struct sim_jitter jitter;
+	struct replica_run *runs;
+	unsigned int nr_metrics;	/* # of values in @runs[i].metrics */
+};
+
+/**
+ * Make and simulate a replica, keeping its results only. So no more
+ * replicas than the threads are in memory at once
+ */
+static void __replicate_one(void *arg, unsigned int job)
+{
+	struct replica_set *set = arg;
+	struct replica_run *run = set->runs + job;
+	struct sim_context *sim = run->sim;
+	const struct sim_metrics *metrics;
+	unsigned long nr;
+
+	if (!sim) {
+		sim = sim_replicate(set->base, set->sched, &set->options,
+				&set->jitter, run->seed);
+	}
+	if (!sim) {
+		run->failed = true;
+		return;
+	}
+
+	sim_run_until(sim, UINT_MAX);
+
+	nr = sim->stats.nr_exited ? sim->stats.nr_exited : 1;
+	run->ticks = sim->ticks;
+	run->nr_exited = sim->stats.nr_exited;
+	run->nr_unfinished = sim->stats.nr_forked - sim->stats.nr_exited;
+	run->turnaround = (double)sim->stats.turnaround / nr;
+	run->waiting = (double)sim->stats.waiting / nr;
+
+	metrics = sim_metrics(sim);
+	for (unsigned int i = 0; i < metrics_nr_histograms(); i++) {
+		const struct histogram *h = metrics_histogram(metrics, i);
+
+		for (unsigned int j = 0; j < NR_REPLICA_STATS; j++) {
+			run->metrics[i * NR_REPLICA_STATS + j] = __replica_stats[j].percent ?
+					histogram_percentile(h, __replica_stats[j].percent) :
+					histogram_mean(h);
+		}
+	}
+
+	/* The metrics are aggregated over the replicas instead */
+	sim->options.report_metrics = false;
+	sim_destroy(sim);
+	run->sim = NULL;
+}
+
+/**
+ * Quantile of Student's t-distribution for the two-sided 95% confidence
+ * interval with @df degrees of freedom
+ */
+static double __t_quantile(unsigned int df)
+{
+	static const double quantiles[] = {
+		0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+		2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+		2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045,
+		2.042,
+	};
+
+	if (df < sizeof(quantiles) / sizeof(*quantiles)) return quantiles[df];
+	if (df <= 40) return 2.021;
+	if (df <= 60) return 2.000;
+	if (df <= 120) return 1.980;
+	return 1.960;
+}
+
+static void __print_interval(const char *name, const double *values, unsigned int nr)
+{
+	double sum = 0, min = values[0], max = values[0];
+	double mean, variance = 0, stddev;
+
+	for (unsigned int i = 0; i < nr; i++) {
+		sum += values[i];
+		if (values[i] < min) min = values[i];
+		if (values[i] > max) max = values[i];
+	}
+	mean = sum / nr;
+
+	for (unsigned int i = 0; i < nr; i++) {
+		variance += (values[i] - mean) * (values[i] - mean);
+	}
+	stddev = sqrt(variance / (nr - 1));
+
+	printf("%-16s %12.2f %12.2f %12.2f %12.2f %12.2f\n", name, mean,
+			__t_quantile(nr - 1) * stddev / sqrt(nr), stddev, min, max);
+}
+
+/**
+ * Print the results of the replicas, and their intervals over the ones that
+ * finished all processes. The others are only listed. Returns false if any
+ * did not finish
+ */
+static bool __print_replicas(struct replica_set *set, unsigned int nr_runs,
+		bool quiet)
+{
+	struct replica_run *runs = set->runs;
+	struct replica_run **finished = malloc(sizeof(*finished) * nr_runs);
+	double *values = malloc(sizeof(*values) * nr_runs);
+	unsigned int nr = 0;
+
+	if (!quiet) {
+		printf("%8s %20s %10s %9s %14s %12s\n",
+				"Replica", "Seed", "Ticks", "Processes",
+				"Avg turnaround", "Avg waiting");
+		for (unsigned int i = 0; i < nr_runs; i++) {
+			printf("%8u %20llu %10u %9lu %14.2f %12.2f\n", i, runs[i].seed,
+					runs[i].ticks, runs[i].nr_exited,
+					runs[i].turnaround, runs[i].waiting);
+		}
+		printf("\n");
+	}
+
+	if (!finished || !values) {
+		fprintf(stderr, "Out of memory while summarizing the replicas\n");
+		free(finished);
+		free(values);
+		return false;
+	}
+
+	for (unsigned int i = 0; i < nr_runs; i++) {
+		if (runs[i].nr_unfinished) {
+			fprintf(stderr, "Replica %u of seed %llu left %lu processes unfinished\n",
+					i, runs[i].seed, runs[i].nr_unfinished);
+			continue;
+		}
+		finished[nr++] = runs + i;
+	}
+	if (nr < 2) {
+		fprintf(stderr, "Too few replicas finished to summarize\n");
+		goto out;
+	}
+	if (nr < nr_runs) {
+		fprintf(stderr, "Summarizing the %u replicas finished\n\n", nr);
+	}
+
+	printf("%-16s %12s %12s %12s %12s %12s\n",
+			"Over replicas", "Mean", "95% CI +/-", "Stddev", "Min", "Max");
+
+	for (unsigned int i = 0; i < nr; i++) values[i] = finished[i]->ticks;
+	__print_interval("ticks", values, nr);
+
+	for (unsigned int i = 0; i < nr; i++) values[i] = finished[i]->waiting;
+	__print_interval("waiting mean", values, nr);
+
+	for (unsigned int m = 0; m < set->nr_metrics; m++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "%s %s",
+				metrics_histogram_name(m / NR_REPLICA_STATS),
+				__replica_stats[m % NR_REPLICA_STATS].name);
+
+		for (unsigned int i = 0; i < nr; i++) values[i] = finished[i]->metrics[m];
+		__print_interval(name, values, nr);
+	}
+
+out:
+	free(finished);
+	free(values);
+	return nr == nr_runs;
+}
+
+/**
+ * Load @scriptfile once, and simulate @nr_replicas replicas of it perturbed
+ * by @jitter with @sched on @nr_threads threads. Replica i is drawn from
+ * @seed + i, so any of them can be simulated alone again with -N 1
+ */
+static int __replicate(const char *scriptfile, bool streaming,
+		const struct scheduler *sched, struct sim_options *options,
+		unsigned int nr_replicas, const struct sim_jitter *jitter,
+		unsigned long long seed, unsigned int nr_threads)
+{
+	struct replica_set set = {
+		.sched = sched,
+		.options = *options,
+		.jitter = *jitter,
+	};
+	double *metrics = NULL;
+	int ret = EXIT_FAILURE;
+
+	/* The traces of the replicas are not kept */
+	set.options.quiet = true;
+	set.options.silent_status = true;
+	set.options.report_metrics = true;
+	set.options.metrics_file = NULL;
+	set.options.eventlog_file = NULL;
+	set.options.profile = false;
+	set.options.digest_trace = false;
+	set.options.trace_fd = open("/dev/null", O_WRONLY);
+	if (set.options.trace_fd < 0) {
+		fprintf(stderr, "Cannot open /dev/null\n");
+		return EXIT_FAILURE;
+	}
+
+	set.nr_metrics = metrics_nr_histograms() * NR_REPLICA_STATS;
+	set.runs = calloc(nr_replicas, sizeof(*set.runs));
+	metrics = calloc((size_t)nr_replicas * set.nr_metrics, sizeof(*metrics));
+	if (!set.runs || !metrics) {
+		fprintf(stderr, "Out of memory for %u replicas\n", nr_replicas);
+		goto out;
+	}
+	for (unsigned int i = 0; i < nr_replicas; i++) {
+		set.runs[i].seed = seed + i;
+		set.runs[i].metrics = metrics + (size_t)i * set.nr_metrics;
+	}
+
+	set.base = __load_base(scriptfile, streaming, options);
+	if (!set.base) goto out;
+
+	/* This loads all of the base, so the threads only read it */
+	set.runs[0].sim = sim_replicate(set.base, sched, &set.options,
+			&set.jitter, set.runs[0].seed);
+	if (!set.runs[0].sim) goto out;
+
+	if (!options->quiet) {
+		printf("Replicating %s scheduler over %s %u times from seed %llu with %u thread%s\n",
+				sched->name, scriptfile, nr_replicas, seed,
+				nr_threads, nr_threads >= 2 ? "s" : "");
+		printf("Jittering start ticks by %u, lifespans by %u, and acquisitions by %u\n\n",
+				jitter->start, jitter->lifespan, jitter->acquire);
+	}
+
+	thread_pool_run(nr_threads, nr_replicas, __replicate_one, &set);
+
+	for (unsigned int i = 0; i < nr_replicas; i++) {
+		if (set.runs[i].failed) goto out;
+	}
+
+	if (__print_replicas(&set, nr_replicas, options->quiet)) ret = EXIT_SUCCESS;
+
+out:
+	if (set.runs && set.runs[0].sim) sim_destroy(set.runs[0].sim);
+	if (set.base) sim_destroy(set.base);
+	free(set.runs);
+	free(metrics);
+	close(set.options.trace_fd);
+	return ret;
+}
+
+
+/**
+ * A line for the benchmark, in a fixed order to compare runs over time
+ */
+static void __print_bench(struct sim_context *sim,
+		const struct scheduler *sched, double load_time, double sim_time)
+{
+	struct rusage usage;
+	unsigned long long nr_events = sim_nr_events(sim);
+	const char *tag = "?";
+
+	for (int i = 0; i < NR_SCHEDULERS; i++) {
+		if (__schedulers[i].sched == sched) tag = __schedulers[i].tag;
+	}
+	getrusage(RUSAGE_SELF, &usage);
+
+	printf("sched=%s processes=%lu ticks=%u load_ms=%.2f sim_ms=%.2f "
+			"ticks_per_sec=%.0f events=%llu events_per_sec=%.0f peak_rss_kb=%ld\n",
+			tag, sim->stats.nr_exited, sim->ticks,
+			load_time * 1e3, sim_time * 1e3,
+			sim_time > 0 ? sim->ticks / sim_time : 0, nr_events,
+			sim_time > 0 ? nr_events / sim_time : 0, usage.ru_maxrss);
+}
+
+/**
+ * Print the digest of the text trace in @filename, to compare with digests
+ * printed with -D
+ */
+static int __digest_trace(const char *filename)
+{
+	struct trace trace;
+	FILE *file = strcmp(filename, "-") ? fopen(filename, "r") : stdin;
+	unsigned long malformed;
+
+	if (!file) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return EXIT_FAILURE;
+	}
+	if (trace_init(&trace, STDOUT_FILENO)) {
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+	trace.digest = true;
+
+	malformed = trace_digest_text(&trace, file);
+	if (file != stdin) fclose(file);
+
+	if (malformed) {
+		fprintf(stderr, "Malformed record at line %lu of %s\n", malformed, filename);
+		trace_fini(&trace);
+		return EXIT_FAILURE;
+	}
+
+	trace_write_digest(&trace);
+	trace_fini(&trace);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char * const argv[])
+{
+	int opt;
+	char *scriptfile;
+	char *workload_file = NULL;
+	bool streaming = false;
+	const struct scheduler *sched = DEFAULT_SCHEDULER;
+	struct sim_options options = {
+		.trace_fd = STDERR_FILENO,
+	};
+	struct sim_context *sim;
+	bool loaded;
+	char *sweep_prefix = NULL;
+	unsigned int selected = 0;
+	unsigned int nr_threads = thread_pool_nr_cpus();
+	bool bench = false;
+	double begin, load_time;
+	char *checkpoint_file = NULL;
+	char *restore_file = NULL;
+	unsigned int interval = 1000;
+	bool digest_text = false;
+	unsigned int nr_replicas = 0;
+	struct sim_jitter jitter = { 0 };
+	unsigned long long seed = 1;
+
+	while ((opt = getopt(argc, argv, "qFzeTDGMo:LW:j:n:mx:PBC:I:R:Q:E:K:N:J:Y:fsSrpicvh")) != -1) {
+		switch (opt) {
+		case 'q':
+			options.quiet = true;
+			break;
+		case 'T':
+			options.compact_trace = true;
+			break;
+		case 'D':
+			options.digest_trace = true;
+			break;
+		case 'G':
+			digest_text = true;
+			break;
+		case 'M':
+			options.report_memory = true;
+			break;
+		case 'm':
+			options.report_metrics = true;
+			break;
+		case 'P':
+			options.profile = true;
+			break;
+		case 'B':
+			bench = true;
+			options.quiet = true;
+			options.silent_status = true;
+			break;
+		case 'C':
+			checkpoint_file = optarg;
+			break;
+		case 'I':
+			if (!__parse_count(optarg, INT_MAX, &interval)) goto invalid;
+			break;
+		case 'R':
+			restore_file = optarg;
+			break;
+		case 'E': {
+			size_t len = strlen(optarg);
+
+			options.eventlog_file = optarg;
+			options.eventlog_json = len >= 6 && strcmp(optarg + len - 6, ".jsonl") == 0;
+			break;
+		}
+		case 'N':
+			if (!__parse_count(optarg, INT_MAX, &nr_replicas)) goto invalid;
+			break;
+		case 'J':
+			if (sscanf(optarg, "%u,%u,%u", &jitter.start,
+						&jitter.lifespan, &jitter.acquire) < 1) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'Y':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'K':
+			if (!__parse_count(optarg, INT_MAX, &options.flight_recorder)) goto invalid;
+			break;
+		case 'x': {
+			size_t len = strlen(optarg);
+
+			options.metrics_file = optarg;
+			options.metrics_json = len >= 5 && strcmp(optarg + len - 5, ".json") == 0;
+			break;
+		}
+		case 'o':
+			workload_file = optarg;
+			options.quiet = true;
+			break;
+		case 'L':
+			streaming = true;
+			break;
+		case 'e':
+			options.event_driven = true;
+			options.fast_forward = true;
+			break;
+		case 'z':
+			options.compress_trace = true;
+			/* Fall through */
+		case 'F':
+			options.fast_forward = true;
+			break;
+
+		case 'W':
+			sweep_prefix = optarg;
+			break;
+		case 'n':
+			if (!__parse_count(optarg, MAX_NR_CPUS, &options.nr_cpus)) goto invalid;
+			break;
+		case 'Q':
+			if (!__parse_count(optarg, INT_MAX, &options.quantum)) goto invalid;
+			break;
+		case 'j':
+			if (!__parse_count(optarg, MAX_NR_THREADS, &nr_threads)) goto invalid;
+			options.nr_threads = nr_threads;
+			break;
+
+		case 'f':
+		case 's':
+		case 'S':
+		case 'r':
+		case 'p':
+		case 'i':
+		case 'c':
+		case 'v':
+			sched = __schedulers[__find_scheduler(opt)].sched;
+			selected |= 1 << __find_scheduler(opt);
+			break;
+		case 'h':
+		default:
+		invalid:
+			__print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc && (!restore_file || digest_text)) {
+		__print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (digest_text) return __digest_trace(argv[optind]);
+
+	scriptfile = restore_file ? restore_file : argv[optind];
+
+	if (nr_replicas && (sweep_prefix || restore_file)) {
+		fprintf(stderr, "Replicas can be neither swept nor restored\n");
+		return EXIT_FAILURE;
+	}
+
+	if (nr_replicas > 1) {
+		return __replicate(scriptfile, streaming, sched, &options,
+				nr_replicas, &jitter, seed, nr_threads);
+	}
+
+	if (sweep_prefix) {
+		if (!selected) selected = __available_schedulers();
+		return __sweep(scriptfile, streaming, restore_file != NULL, selected, &options,
+				sweep_prefix, nr_threads);
+	}
+
+	begin = __now();
+	if (restore_file) {
+		sim = sim_restore(restore_file, sched, &options);
+		if (!sim) {
+			return EXIT_FAILURE;
+		}
+	} else if (nr_replicas) {
+		struct sim_context *base = __load_base(scriptfile, streaming, &options);
+
+		if (!base) return EXIT_FAILURE;
+
+		sim = sim_replicate(base, sched, &options, &jitter, seed);
+		sim_destroy(base);
+		if (!sim) {
+			return EXIT_FAILURE;
+		}
+	} else {
+		sim = sim_create(sched, &options);
+		if (!sim) {
+			return EXIT_FAILURE;
+		}
+
+		if (streaming) {
+			loaded = sim_stream(sim, scriptfile);
+		} else {
+			loaded = sim_load(sim, scriptfile);
+		}
+		if (!loaded) {
+			return EXIT_FAILURE;
+		}
+	}
+	load_time = __now() - begin;
+
+	if (workload_file) {
+		bool compiled = sim_compile(sim, workload_file);
+
+		sim_destroy(sim);
+		return compiled ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	begin = __now();
+	if (checkpoint_file) {
+		/* Checkpoint on every multiple of @interval until it is over */
+		while (sim_run_until(sim, (sim->ticks / interval + 1) * interval)) {
+			if (!sim_checkpoint(sim, checkpoint_file)) {
+				sim_destroy(sim);
+				return EXIT_FAILURE;
+			}
+		}
+	} else {
+		sim_run_until(sim, UINT_MAX);
+	}
+
+	if (bench) __print_bench(sim, sched, load_time, __now() - begin);
+
+	return sim_destroy(sim) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+/*          ******        DO NOT MODIFY THIS FILE        ******       */
+/*====================================================================*/
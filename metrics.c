@@ -0,0 +1,266 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "types.h"
+#include "list_head.h"
+#include "process.h"
+#include "metrics.h"
+
+static const struct {
+	const char *name;
+	size_t offset;
+} __histograms[] = {
+	{ "turnaround", offsetof(struct sim_metrics, turnaround) },
+	{ "response", offsetof(struct sim_metrics, response) },
+	{ "ready", offsetof(struct sim_metrics, ready) },
+	{ "blocked", offsetof(struct sim_metrics, blocked) },
+	{ "switches", offsetof(struct sim_metrics, switches) },
+};
+#define NR_HISTOGRAMS	(sizeof(__histograms) / sizeof(__histograms[0]))
+
+static inline struct histogram *__histogram(struct sim_metrics *metrics, int i)
+{
+	return (struct histogram *)((char *)metrics + __histograms[i].offset);
+}
+
+struct sim_metrics *metrics_create(const char *filename, bool json,
+		const char *sched_name)
+{
+	struct sim_metrics *metrics = calloc(1, sizeof(*metrics));
+
+	if (!metrics) return NULL;
+
+	for (int i = 0; i < NR_HISTOGRAMS; i++) {
+		histogram_init(__histogram(metrics, i));
+	}
+	metrics->sched_name = sched_name;
+	metrics->json = json;
+	pool_init(&metrics->processes, "process_metrics", sizeof(struct process_metrics));
+
+	if (!filename) return metrics;
+
+	metrics->file = fopen(filename, "w");
+	if (!metrics->file) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		pool_destroy(&metrics->processes);
+		free(metrics);
+		return NULL;
+	}
+
+	if (json) {
+		fprintf(metrics->file, "{\n  \"scheduler\": \"%s\",\n  \"processes\": [", sched_name);
+	} else {
+		fprintf(metrics->file, "pid,prio,start,lifespan,first_run,exit,"
+				"turnaround,response,ready,blocked,switches\n");
+	}
+	return metrics;
+}
+
+bool metrics_reserve_resources(struct sim_metrics *metrics, unsigned int nr_resources)
+{
+	unsigned long long *blocked;
+
+	if (nr_resources <= metrics->nr_resources) return true;
+
+	blocked = realloc(metrics->blocked_by_resource, sizeof(*blocked) * nr_resources);
+	if (!blocked) return false;
+
+	memset(blocked + metrics->nr_resources, 0x00,
+			sizeof(*blocked) * (nr_resources - metrics->nr_resources));
+	metrics->blocked_by_resource = blocked;
+	metrics->nr_resources = nr_resources;
+	return true;
+}
+
+/**
+ * Write the record of @p into the file of @metrics
+ */
+static void __write_record(struct sim_metrics *metrics, struct process *p,
+		struct process_metrics *pm, unsigned int tick,
+		unsigned int turnaround, unsigned int response)
+{
+	if (metrics->json) {
+		fprintf(metrics->file, "%s\n    { \"pid\": %u, \"prio\": %u, \"start\": %u, "
+				"\"lifespan\": %u, \"first_run\": %u, \"exit\": %u, "
+				"\"turnaround\": %u, \"response\": %u, \"ready\": %u, "
+				"\"blocked\": %u, \"switches\": %u }",
+				metrics->nr_records ? "," : "",
+				p->pid, p->prio_orig, p->__starts_at, p->lifespan,
+				pm->first_run, tick, turnaround, response,
+				pm->ready_ticks, pm->blocked_ticks, pm->nr_switches);
+	} else {
+		fprintf(metrics->file, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+				p->pid, p->prio_orig, p->__starts_at, p->lifespan,
+				pm->first_run, tick, turnaround, response,
+				pm->ready_ticks, pm->blocked_ticks, pm->nr_switches);
+	}
+	metrics->nr_records++;
+}
+
+bool metrics_fork_process(struct sim_metrics *metrics, struct process *p,
+		unsigned int tick)
+{
+	struct process_metrics *pm = pool_alloc(&metrics->processes);
+
+	if (!pm) return false;
+
+	memset(pm, 0x00, sizeof(*pm));
+	pm->first_run = UINT_MAX;
+	pm->ready_since = tick;
+	p->__metrics = pm;
+	return true;
+}
+
+void metrics_exit_process(struct sim_metrics *metrics, struct process *p,
+		unsigned int tick)
+{
+	struct process_metrics *pm = p->__metrics;
+	unsigned int turnaround = tick - p->__starts_at;
+	unsigned int response = pm->first_run - p->__starts_at;
+
+	histogram_add(&metrics->turnaround, turnaround);
+	histogram_add(&metrics->response, response);
+	histogram_add(&metrics->ready, pm->ready_ticks);
+	histogram_add(&metrics->blocked, pm->blocked_ticks);
+	histogram_add(&metrics->switches, pm->nr_switches);
+
+	if (metrics->file) __write_record(metrics, p, pm, tick, turnaround, response);
+
+	pool_free(&metrics->processes, pm);
+	p->__metrics = NULL;
+}
+
+#define NR_TOP_RESOURCES	5
+
+/**
+ * Find up to NR_TOP_RESOURCES resources with the most blocked ticks
+ */
+static unsigned int __top_resources(struct sim_metrics *metrics, unsigned int *top)
+{
+	unsigned int nr = 0;
+
+	for (unsigned int i = 0; i < metrics->nr_resources; i++) {
+		unsigned long long ticks = metrics->blocked_by_resource[i];
+		unsigned int j;
+
+		if (!ticks) continue;
+
+		if (nr < NR_TOP_RESOURCES) {
+			nr++;
+		} else if (ticks <= metrics->blocked_by_resource[top[nr - 1]]) {
+			continue;
+		}
+
+		for (j = nr - 1; j > 0 && metrics->blocked_by_resource[top[j - 1]] < ticks; j--) {
+			top[j] = top[j - 1];
+		}
+		top[j] = i;
+	}
+	return nr;
+}
+
+void metrics_report(struct sim_metrics *metrics)
+{
+	unsigned int top[NR_TOP_RESOURCES];
+	unsigned int nr_top;
+
+	printf("\n");
+	printf("Scheduling metrics of %llu processes with %s (in ticks):\n",
+			metrics->turnaround.nr, metrics->sched_name);
+	printf("  %-12s %12s %10s %10s %10s %10s\n",
+			"", "Mean", "p50", "p99", "p99.9", "Max");
+
+	for (int i = 0; i < NR_HISTOGRAMS; i++) {
+		struct histogram *h = __histogram(metrics, i);
+
+		printf("  %-12s %12.2f %10llu %10llu %10llu %10llu\n",
+				__histograms[i].name, histogram_mean(h),
+				histogram_percentile(h, 50), histogram_percentile(h, 99),
+				histogram_percentile(h, 99.9), h->max);
+	}
+
+	nr_top = __top_resources(metrics, top);
+	if (!nr_top) return;
+
+	printf("  Most waited resources:");
+	for (unsigned int i = 0; i < nr_top; i++) {
+		printf(" %u (%llu)", top[i], metrics->blocked_by_resource[top[i]]);
+	}
+	printf("\n");
+}
+
+unsigned int metrics_nr_histograms(void)
+{
+	return NR_HISTOGRAMS;
+}
+
+const struct histogram *metrics_histogram(const struct sim_metrics *metrics,
+		unsigned int i)
+{
+	assert(i < NR_HISTOGRAMS);
+
+	return (const struct histogram *)((const char *)metrics + __histograms[i].offset);
+}
+
+const char *metrics_histogram_name(unsigned int i)
+{
+	assert(i < NR_HISTOGRAMS);
+
+	return __histograms[i].name;
+}
+
+void metrics_destroy(struct sim_metrics *metrics)
+{
+	if (metrics->file) {
+		if (metrics->json) {
+			bool first = true;
+
+			fprintf(metrics->file, "\n  ],\n  \"summary\": {");
+			for (int i = 0; i < NR_HISTOGRAMS; i++) {
+				struct histogram *h = __histogram(metrics, i);
+
+				fprintf(metrics->file, "%s\n    \"%s\": { \"count\": %llu, "
+						"\"mean\": %.2f, \"p50\": %llu, \"p99\": %llu, "
+						"\"p999\": %llu, \"max\": %llu }",
+						i ? "," : "", __histograms[i].name, h->nr,
+						histogram_mean(h), histogram_percentile(h, 50),
+						histogram_percentile(h, 99),
+						histogram_percentile(h, 99.9), h->max);
+			}
+			fprintf(metrics->file, "\n  },\n  \"blocked_by_resource\": {");
+			for (unsigned int i = 0; i < metrics->nr_resources; i++) {
+				if (!metrics->blocked_by_resource[i]) continue;
+
+				fprintf(metrics->file, "%s\n    \"%u\": %llu", first ? "" : ",",
+						i, metrics->blocked_by_resource[i]);
+				first = false;
+			}
+			fprintf(metrics->file, "\n  }\n}\n");
+		}
+		if (fclose(metrics->file)) {
+			fprintf(stderr, "Cannot write the metrics\n");
+		}
+	}
+
+	pool_destroy(&metrics->processes);
+	free(metrics->blocked_by_resource);
+	free(metrics);
+}
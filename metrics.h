@@ -0,0 +1,151 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdio.h>
+
+#include "types.h"
+#include "histogram.h"
+#include "pool.h"
+
+struct process;
+
+/**
+ * Events of a process counted while it is alive. All of them are in ticks
+ * except @nr_switches.
+ */
+struct process_metrics {
+	unsigned int first_run;		/* The tick it ran for the first time, or UINT_MAX */
+	unsigned int ready_since;	/* The tick it got ready to run at */
+	unsigned int blocked_since;	/* The tick it blocked at */
+	int blocked_on;				/* The resource it blocked on */
+	unsigned int ready_ticks;	/* Ticks in the ready queue */
+	unsigned int blocked_ticks;	/* Ticks waiting for resources */
+	unsigned int nr_switches;	/* # of times switched in */
+};
+
+/**
+ * Scheduling metrics collected while simulating. The framework counts the
+ * events of each process into its process_metrics as they happen, and adds
+ * the process into the histograms when it exits. The per-process records are
+ * written to @file at the same time, so nothing is kept for the processes
+ * gone. All of them are in ticks.
+ */
+struct sim_metrics {
+	const char *sched_name;
+	struct histogram turnaround;	/* From fork to exit */
+	struct histogram response;		/* From fork to the first run */
+	struct histogram ready;			/* Waiting in the ready queue */
+	struct histogram blocked;		/* Waiting for resources */
+	struct histogram switches;		/* # of times being switched in */
+
+	/* Ticks that processes waited for each resource */
+	unsigned long long *blocked_by_resource;
+	unsigned int nr_resources;
+
+	FILE *file;					/* Per-process records go here if not NULL */
+	bool json;					/* in JSON instead of CSV */
+	unsigned long nr_records;
+
+	struct pool processes;		/* of struct process_metrics of live ones */
+};
+
+/***********************************************************************
+ * metrics_create()
+ *
+ * DESCRIPTION
+ *   Create the metrics of simulating @sched_name. Per-process records are
+ *   written to @filename if it is not NULL, in JSON if @json is set or in
+ *   CSV otherwise.
+ *
+ * RETURN
+ *   The metrics, or NULL on error
+ */
+struct sim_metrics *metrics_create(const char *filename, bool json,
+		const char *sched_name);
+
+/***********************************************************************
+ * metrics_reserve_resources()
+ *
+ * DESCRIPTION
+ *   Make @metrics count the blocked ticks for @nr_resources resources.
+ */
+bool metrics_reserve_resources(struct sim_metrics *metrics, unsigned int nr_resources);
+
+/***********************************************************************
+ * metrics_fork_process()
+ *
+ * DESCRIPTION
+ *   Start counting the events of @p which is forked at @tick.
+ *
+ * RETURN
+ *   false if running out of memory
+ */
+bool metrics_fork_process(struct sim_metrics *metrics, struct process *p,
+		unsigned int tick);
+
+/***********************************************************************
+ * metrics_exit_process()
+ *
+ * DESCRIPTION
+ *   Count @p exiting at @tick into @metrics, and stop counting its events.
+ */
+void metrics_exit_process(struct sim_metrics *metrics, struct process *p,
+		unsigned int tick);
+
+/***********************************************************************
+ * metrics_report()
+ *
+ * DESCRIPTION
+ *   Print the summary of @metrics to the standard output.
+ */
+void metrics_report(struct sim_metrics *metrics);
+
+/***********************************************************************
+ * metrics_nr_histograms()
+ *
+ * DESCRIPTION
+ *   The number of histograms in the metrics.
+ */
+unsigned int metrics_nr_histograms(void);
+
+/***********************************************************************
+ * metrics_histogram()
+ *
+ * DESCRIPTION
+ *   Histogram @i of @metrics, in the order metrics_report() prints them.
+ */
+const struct histogram *metrics_histogram(const struct sim_metrics *metrics,
+		unsigned int i);
+
+/***********************************************************************
+ * metrics_histogram_name()
+ *
+ * DESCRIPTION
+ *   The name of histogram @i as metrics_report() prints it.
+ */
+const char *metrics_histogram_name(unsigned int i);
+
+/***********************************************************************
+ * metrics_destroy()
+ *
+ * DESCRIPTION
+ *   Finish the records file with the summary, and release @metrics.
+ */
+void metrics_destroy(struct sim_metrics *metrics);
+
+#endif
@@ -17,40 +17,46 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "types.h"
 #include "list_head.h"
+#include "process.h"
+#include "resource.h"
+#include "sim.h"
 
 /**
- * The process which is currently running
+ * The framework keeps the state of each simulation in its own context, and
+ * @this_sim points to the one being simulated. @this_cpu is the processor
+ * of the simulation being scheduled. Followings are shorthands for their
+ * members.
  */
-#include "process.h"
-extern struct process *current;
 
 /**
- * List head to hold the processes ready to run
+ * The process which is currently running on this processor
  */
-extern struct list_head readyqueue;
+#define current		(this_cpu->current)
 
+/**
+ * List head to hold the processes ready to run on this processor
+ */
+#define readyqueue	(this_cpu->readyqueue)
 
 /**
  * Resources in the system.
  */
-#include "resource.h"
-extern struct resource resources[NR_RESOURCES];
-
+#define resources	(this_sim->resources)
 
 /**
  * Monotonically increasing ticks
  */
-extern unsigned int ticks;
-
+#define ticks		(this_sim->ticks)
 
 /**
  * Quiet mode. True if the program was started with -q option
  */
-extern bool quiet;
+#define quiet		(this_sim->options.quiet)
 
 
 /***********************************************************************
@@ -89,17 +95,18 @@ bool fcfs_acquire(int resource_id)
 }
 
 /***********************************************************************
- * Default FCFS resource release function
+ * Release a resource and pick the waiter in the FCFS way
  *
  * DESCRIPTION
- *   This is the default resource release function which is called back
- *   whenever the current process is to release resource @resource_id.
- *   The current implementation serves the resource in the requesting order
- *   without considering the priority. See the comments in sched.h
+ *   Un-own resource @resource_id from the current process and take out the
+ *   waiter that came first from the waitqueue. The waiter is returned in the
+ *   ready status to be put into the ready queue of the scheduler, or NULL
+ *   if no one is waiting for the resource.
  ***********************************************************************/
-void fcfs_release(int resource_id)
+static struct process *__fcfs_wake_up(int resource_id)
 {
 	struct resource *r = resources + resource_id;
+	struct process *waiter;
 
 	/* Ensure that the owner process is releasing the resource */
 	assert(r->owner == current);
@@ -108,31 +115,70 @@ void fcfs_release(int resource_id)
 	r->owner = NULL;
 
 	/* Let's wake up ONE waiter (if exists) that came first */
-	if (!list_empty(&r->waitqueue)) {
-		struct process *waiter =
-				list_first_entry(&r->waitqueue, struct process, list);
+	if (list_empty(&r->waitqueue)) return NULL;
 
-		/**
-		 * Ensure the waiter  is in the wait status
-		 */
-		assert(waiter->status == PROCESS_WAIT);
+	waiter = list_first_entry(&r->waitqueue, struct process, list);
 
-		/**
-		 * Take out the waiter from the waiting queue. Note we use
-		 * list_del_init() over list_del() to maintain the list head tidy
-		 * (otherwise, the framework will complain on the list head
-		 * when the process exits).
-		 */
-		list_del_init(&waiter->list);
+	/**
+	 * Ensure the waiter  is in the wait status
+	 */
+	assert(waiter->status == PROCESS_WAIT);
+
+	/**
+	 * Take out the waiter from the waiting queue. Note we use
+	 * list_del_init() over list_del() to maintain the list head tidy
+	 * (otherwise, the framework will complain on the list head
+	 * when the process exits).
+	 */
+	list_del_init(&waiter->list);
 
-		/* Update the process status */
-		waiter->status = PROCESS_READY;
+	/* Update the process status */
+	waiter->status = PROCESS_READY;
+
+	return waiter;
+}
+
+static void __fcfs_enqueue(struct process *p)
+{
+	list_add_tail(&p->list, &readyqueue);
+}
 
+/***********************************************************************
+ * Put a woken-up process into a run queue
+ *
+ * DESCRIPTION
+ *   Let the framework pick the processor for @p, and put @p into its run
+ *   queue with @enqueue, which puts a process into the run queue of
+ *   @this_cpu.
+ ***********************************************************************/
+static void __enqueue_woken(struct process *p, void (*enqueue)(struct process *))
+{
+	struct sim_cpu *waker = this_cpu;
+
+	this_cpu = sim_place_process(p, true);
+	enqueue(p);
+	this_cpu = waker;
+}
+
+/***********************************************************************
+ * Default FCFS resource release function
+ *
+ * DESCRIPTION
+ *   This is the default resource release function which is called back
+ *   whenever the current process is to release resource @resource_id.
+ *   The current implementation serves the resource in the requesting order
+ *   without considering the priority. See the comments in sched.h
+ ***********************************************************************/
+void fcfs_release(int resource_id)
+{
+	struct process *waiter = __fcfs_wake_up(resource_id);
+
+	if (waiter) {
 		/**
 		 * Put the waiter process into ready queue. The framework will
 		 * do the rest.
 		 */
-		list_add_tail(&waiter->list, &readyqueue);
+		__enqueue_woken(waiter, __fcfs_enqueue);
 	}
 }
 
@@ -199,8 +245,9 @@ pick_next:
 	return next;
 }
 
-struct scheduler fifo_scheduler = {
+const struct scheduler fifo_scheduler = {
 	.name = "FIFO",
+	.preempt = PREEMPT_NONE,
 	.acquire = fcfs_acquire,
 	.release = fcfs_release,
 	.initialize = fifo_initialize,
@@ -210,234 +257,969 @@ struct scheduler fifo_scheduler = {
 
 
 /***********************************************************************
- * SJF scheduler
+ * SJF and SRTF schedulers
+ *
+ * Both keep the ready processes in the min-heap @ready_heap instead of
+ * @readyqueue. SJF keys them by the lifespan and SRTF by the remaining time
+ * when they are put into the heap, which does not change while they are
+ * waiting there. The heap breaks ties in the order the processes arrive to
+ * the heap, so the earlier one wins. Each simulation has its own heap in
+ * its @sched_data.
  ***********************************************************************/
+#include "heap.h"
+
+static inline struct heap *__ready_heap(void)
+{
+	return this_cpu->sched_data;
+}
+
+static inline unsigned int __remaining_time(struct process *p)
+{
+	return p->lifespan - p->age;
+}
+
+static void __heap_enqueue(struct process *p, unsigned int key)
+{
+	if (heap_push(__ready_heap(), key, p)) {
+		fprintf(stderr, "Out of memory while enqueueing process %d\n", p->pid);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static int heap_initialize(void)
+{
+	struct heap *heap = malloc(sizeof(*heap));
+
+	if (!heap) return -1;
+
+	heap_init(heap);
+	this_cpu->sched_data = heap;
+	return 0;
+}
+
+static void heap_finalize(void)
+{
+	heap_fini(__ready_heap());
+	free(__ready_heap());
+	this_cpu->sched_data = NULL;
+}
+
+static void heap_dump(void)
+{
+	for (unsigned int i = 0; i < __ready_heap()->nr_nodes; i++) {
+		dump_process(__ready_heap()->nodes[i].data);
+	}
+}
+
+static struct process *heap_steal(void)
+{
+	return heap_pop(__ready_heap());
+}
+
+static int __compare_heap_nodes(const void *a, const void *b)
+{
+	const struct heap_node *x = a, *y = b;
+
+	if (x->key != y->key) return x->key < y->key ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void heap_for_each_ready(void (*fn)(struct process *, void *), void *data)
+{
+	struct heap *heap = __ready_heap();
+	struct heap_node *nodes;
+
+	if (heap_empty(heap)) return;
+
+	/* The heap is not sorted. Walk a sorted copy in the order to pop */
+	nodes = malloc(sizeof(*nodes) * heap->nr_nodes);
+	if (!nodes) {
+		fprintf(stderr, "Out of memory while walking the ready heap\n");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(nodes, heap->nodes, sizeof(*nodes) * heap->nr_nodes);
+	qsort(nodes, heap->nr_nodes, sizeof(*nodes), __compare_heap_nodes);
+
+	for (unsigned int i = 0; i < heap->nr_nodes; i++) {
+		fn(nodes[i].data, data);
+	}
+	free(nodes);
+}
+
+static void __sjf_enqueue(struct process *p)
+{
+	__heap_enqueue(p, p->lifespan);
+}
+
+static void sjf_forked(struct process *p)
+{
+	/* The framework put @p into @readyqueue. Take it into @ready_heap */
+	list_del_init(&p->list);
+	__sjf_enqueue(p);
+}
+
+static void sjf_release(int resource_id)
+{
+	struct process *waiter = __fcfs_wake_up(resource_id);
+
+	if (waiter) __enqueue_woken(waiter, __sjf_enqueue);
+}
 
 static struct process *sjf_schedule(void)
 {
 	/**
-	 * Implement your own SJF scheduler here.
+	 * SJF is non-preemptive. Keep running the current process until it
+	 * completes or gets blocked.
 	 */
-	
-    // Declare a pointer to the current task in the run queue
-    struct process *curr;
-
-    // Declare a pointer to the task with the shortest expected execution time
-    struct process *shortest = NULL;
-
-    // Initialize the minimum expected execution time to the maximum possible value
-   unsigned long min_exec_time = ULONG_MAX; 
-
-    // Iterate through the run queue
-    list_for_each_entry(curr, &runqueue, run_list)
-    {
-        // If the current task's expected execution time is less than the current minimum
-        if (curr->expected_exec_time < min_exec_time)
-        {
-            // Update the minimum expected execution time and the pointer to the shortest task
-            min_exec_time = curr->expected_exec_time;
-            shortest = curr;
-        }
-    }
-
-    // If a task with the shortest expected execution time was found, return it
-    if (shortest)
-        return shortest;
-
-    // If no task with the shortest expected execution time was found, return NULL
-    return NULL;
-} 
-
-struct scheduler sjf_scheduler = {
+	if (!current || current->status == PROCESS_WAIT) {
+		goto pick_next;
+	}
+
+	if (current->age < current->lifespan) {
+		return current;
+	}
+
+pick_next:
+	/* Pick the shortest one */
+	return heap_pop(__ready_heap());
+}
+
+const struct scheduler sjf_scheduler = {
 	.name = "Shortest-Job First",
+	.preempt = PREEMPT_NONE,
 	.acquire = fcfs_acquire, /* Use the default FCFS acquire() */
-	.release = fcfs_release, /* Use the default FCFS release() */
-	.schedule = sjf_schedule, /* Assign the sjf_schedule() function */
-};	
-/* done TODO: Assign sjf_schedule() to this function pointer to activate SJF in the system */
+	.release = sjf_release,
+	.initialize = heap_initialize,
+	.finalize = heap_finalize,
+	.forked = sjf_forked,
+	.schedule = sjf_schedule,
+	.dump = heap_dump,
+	.steal = heap_steal,
+	.for_each_ready = heap_for_each_ready,
 };
- 
 
 
-/***********************************************************************
- * SRTF scheduler
- ***********************************************************************/
-struct scheduler srtf_scheduler = {
-	.name = "Shortest Remaining Time First",
-	.acquire = fcfs_acquire, /* Use the default FCFS acquire() */
-	.release = fcfs_release, /* Use the default FCFS release() */
-	/* You need to check the newly created processes to implement SRTF.
-	 * Use @forked() callback to mark newly created processes */
-	/* Obviously, you should implement srtf_schedule() and attach it here */
-};
+static void __srtf_enqueue(struct process *p)
+{
+	__heap_enqueue(p, __remaining_time(p));
+}
+
+static void srtf_forked(struct process *p)
+{
+	list_del_init(&p->list);
+	__srtf_enqueue(p);
+}
+
+static void srtf_release(int resource_id)
+{
+	struct process *waiter = __fcfs_wake_up(resource_id);
+
+	if (waiter) __enqueue_woken(waiter, __srtf_enqueue);
+}
 
 static struct process *srtf_schedule(void)
 {
-    // Declare a pointer to the current task in the run queue
-    struct process *curr;
-    // Declare a pointer to the task with the shortest remaining execution time
-    struct process *shortest = NULL;
-    // Initialize the minimum remaining execution time to the maximum possible value
-    unsigned long min_remain_time = ULONG_MAX;
-
-    // Iterate through the run queue
-    list_for_each_entry(curr, &runqueue, run_list)
-    {
-        // If the current task's remaining execution time is less than the current minimum
-        if (curr->remaining_exec_time < min_remain_time)
-        {
-            // Update the minimum remaining execution time and the pointer to the shortest task
-            min_remain_time = curr->remaining_exec_time;
-            shortest = curr;
-        }
-    }
-
-   // If a task with the shortest expected execution time was found, return it
-    if (shortest)
-        return shortest;
-
-    // If no task with the shortest expected execution time was found, return NULL
-    return NULL;
+	struct heap_node *shortest = heap_top(__ready_heap());
+
+	if (current && current->status != PROCESS_WAIT &&
+			current->age < current->lifespan) {
+		/* Do not preempt the current unless a shorter one shows up */
+		if (!shortest || __remaining_time(current) <= shortest->key) {
+			return current;
+		}
+
+		/* Put the preempted current back with its remaining time */
+		__heap_enqueue(current, __remaining_time(current));
+	}
+
+	return heap_pop(__ready_heap());
 }
-/***********************************************************************
- * Round-robin scheduler
- ***********************************************************************/
-struct scheduler rr_scheduler = {
-	.name = "Round-Robin",
+
+const struct scheduler srtf_scheduler = {
+	.name = "Shortest Remaining Time First",
+	.preempt = PREEMPT_EVENT,
 	.acquire = fcfs_acquire, /* Use the default FCFS acquire() */
-	.release = fcfs_release, /* Use the default FCFS release() */
-	/* Obviously, you should implement rr_schedule() and attach it here */
+	.release = srtf_release,
+	.initialize = heap_initialize,
+	.finalize = heap_finalize,
+	.forked = srtf_forked,
+	.schedule = srtf_schedule,
+	.dump = heap_dump,
+	.steal = heap_steal,
+	.for_each_ready = heap_for_each_ready,
 };
 
+
+/***********************************************************************
+ * Round-robin scheduler
+ ***********************************************************************/
 static struct process *rr_schedule(void)
 {
-  // Declare a pointer to the head of the run queue
-    struct process *head = list_first_entry(&runqueue, struct process, run_list);
-	
-    // Declare a pointer to the current task in the run queue
-    struct process *curr;
+	struct process *next = NULL;
 
-    // If the run queue is empty, return NULL
-    if (list_empty(&runqueue))
-        return NULL;
+	/* Put the current back to the tail of the ready queue if it can run */
+	if (current && current->status != PROCESS_WAIT &&
+			current->age < current->lifespan) {
+		/* Nothing preempts it in the middle of the quantum */
+		if (this_cpu->quantum_left) return current;
+
+		list_add_tail(&current->list, &readyqueue);
+	}
 
-    // Move the head of the run queue to the end
-    list_del(&head->run_list);
-    list_add_tail(&head->run_list, &runqueue);
+	if (!list_empty(&readyqueue)) {
+		next = list_first_entry(&readyqueue, struct process, list);
+		list_del_init(&next->list);
+	}
 
-    // Find the new head of the run queue
-    head = list_first_entry(&runqueue, struct process, run_list);
+	return next;
+}
 
-    // Return the new head of the run queue
-    return head;
-	
+const struct scheduler rr_scheduler = {
+	.name = "Round-Robin",
+	.acquire = fcfs_acquire, /* Use the default FCFS acquire() */
+	.release = fcfs_release, /* Use the default FCFS release() */
+	.schedule = rr_schedule,
 };
+
+
 /***********************************************************************
  * Priority scheduler
+ *
+ * The priority-based schedulers (prio, PCP, and PIP) share a priority-indexed
+ * run queue @prio_rq. Processes are moved from @readyqueue into it as soon as
+ * they are forked, and woken-up waiters are put into it directly. Picking
+ * the next process is O(1), and processes with the same priority are
+ * switched in the round-robin way as they are put back to the tail of
+ * their priority level at the end of every quantum. @prio_rq is allocated
+ * for each simulation and kept in its @sched_data.
+ *
+ * Likewise, the processes waiting for a resource are kept in the
+ * priority-ordered waitqueue of the resource, so that the release can hand
+ * the resource to the highest-priority waiter in O(1).
  ***********************************************************************/
-struct scheduler prio_scheduler = {
+#include "prio_array.h"
+#include "prio_waitqueue.h"
+
+static inline struct prio_array *__prio_rq(void)
+{
+	return this_cpu->sched_data;
+}
+
+/**
+ * The run queue of the processor @p is on, which might not be @this_cpu
+ */
+static inline struct prio_array *__prio_rq_of(struct process *p)
+{
+	return this_sim->cpus[p->cpu].sched_data;
+}
+
+static int prio_initialize(void)
+{
+	struct prio_array *prio_rq = malloc(sizeof(*prio_rq));
+
+	if (!prio_rq) return -1;
+
+	prio_array_init(prio_rq);
+	this_cpu->sched_data = prio_rq;
+	return 0;
+}
+
+static void prio_finalize(void)
+{
+	free(__prio_rq());
+	this_cpu->sched_data = NULL;
+}
+
+static void prio_forked(struct process *p)
+{
+	/* The framework put @p into @readyqueue. Take it into @prio_rq */
+	list_del_init(&p->list);
+	prio_array_enqueue(__prio_rq(), p);
+}
+
+static void prio_dump(void)
+{
+	struct process *p;
+	int prio;
+
+	prio_array_for_each_entry(p, __prio_rq(), prio) {
+		dump_process(p);
+	}
+}
+
+static void prio_for_each_ready(void (*fn)(struct process *, void *), void *data)
+{
+	struct process *p;
+	int prio;
+
+	prio_array_for_each_entry(p, __prio_rq(), prio) {
+		fn(p, data);
+	}
+}
+
+/**
+ * Take out the first one with the highest priority. This is also the one
+ * to give to an idle processor
+ */
+static struct process *prio_steal(void)
+{
+	struct process *next = prio_array_first(__prio_rq());
+
+	if (next) {
+		prio_array_dequeue(__prio_rq(), next);
+	}
+	return next;
+}
+
+static void __prio_enqueue(struct process *p)
+{
+	prio_array_enqueue(__prio_rq(), p);
+}
+
+static struct process *prio_schedule(void)
+{
+	if (current && current->status != PROCESS_WAIT &&
+			current->age < current->lifespan) {
+		if (!this_cpu->quantum_left) {
+			prio_array_enqueue(__prio_rq(), current);
+		} else if (prio_array_top(__prio_rq()) > (int)current->prio) {
+			/* Preempted in the middle of the quantum. Go on first in the level */
+			prio_array_enqueue_head(__prio_rq(), current);
+		} else {
+			return current;
+		}
+	}
+
+	return prio_steal();
+}
+
+/**
+ * Change the priority of @p while keeping @prio_rq and the waitqueue it is
+ * in consistent
+ */
+static void __set_prio(struct process *p, unsigned int prio)
+{
+	unsigned int prev = p->prio;
+
+	if (p->prio == prio) return;
+
+	if (p->status == PROCESS_READY && !list_empty(&p->list)) {
+		prio_array_dequeue(__prio_rq_of(p), p);
+		p->prio = prio;
+		prio_array_enqueue(__prio_rq_of(p), p);
+	} else if (p->status == PROCESS_WAIT) {
+		prio_waitqueue_set_prio(sim_prio_waitqueue(p->waiting_for), p, prio);
+	} else {
+		p->prio = prio;
+	}
+	sim_log_prio(p, prev);
+}
+
+static bool prio_acquire(int resource_id)
+{
+	struct resource *r = resources + resource_id;
+
+	if (!r->owner) {
+		r->owner = current;
+		return true;
+	}
+
+	/* Wait in the priority order */
+	current->status = PROCESS_WAIT;
+	current->waiting_for = resource_id;
+	prio_waitqueue_add(sim_prio_waitqueue(resource_id), current);
+
+	return false;
+}
+
+/**
+ * Wake up the waiter with the highest priority on @resource_id. The one
+ * came first wins the tie
+ */
+static void __wake_up_highest(int resource_id)
+{
+	struct resource *r = resources + resource_id;
+	struct process *waiter;
+
+	if (!r->prio_waitqueue) return;
+
+	waiter = prio_waitqueue_first(r->prio_waitqueue);
+	if (!waiter) return;
+
+	assert(waiter->status == PROCESS_WAIT);
+
+	prio_waitqueue_del(r->prio_waitqueue, waiter);
+	waiter->status = PROCESS_READY;
+	__enqueue_woken(waiter, __prio_enqueue);
+}
+
+static void prio_release(int resource_id)
+{
+	struct resource *r = resources + resource_id;
+
+	assert(r->owner == current);
+
+	r->owner = NULL;
+
+	__wake_up_highest(resource_id);
+}
+
+const struct scheduler prio_scheduler = {
 	.name = "Priority",
-	/**
-	 * Implement your own acqure/release function to make priority
-	 * scheduler correct.
-	 */
-	/* Implement your own prio_schedule() and attach it here */
+	.acquire = prio_acquire,
+	.release = prio_release,
+	.initialize = prio_initialize,
+	.finalize = prio_finalize,
+	.forked = prio_forked,
+	.schedule = prio_schedule,
+	.dump = prio_dump,
+	.steal = prio_steal,
+	.for_each_ready = prio_for_each_ready,
 };
 
-static struct process *prio_scheduler(void)
-{
-// Declare a pointer to the process with the highest priority
-    struct process *highest_prio = NULL;
-    // Declare a pointer to the current task in the run queue
-    struct process *curr;
-
-    // Iterate through the run queue
-    list_for_each_entry(curr, &runqueue, run_list)
-    {
-        // If the current task has a higher priority than the current highest priority task
-        if (!highest_prio || curr->priority < highest_prio->priority)
-        {
-            // Update the highest priority task pointer
-            highest_prio = curr;
-        }
-    }
-
-    // Return the task with the highest priority
-    return highest_prio;
-	
-};
 
 /***********************************************************************
  * Priority scheduler with priority ceiling protocol
  ***********************************************************************/
- struct scheduler pcp_scheduler = {
-    .name = "Priority + Priority Ceiling Protocol",
-    .acquire = pcp_acquire,
-    .release = pcp_release,
-    .schedule = pcp_schedule,
-/**
-	 * Implement your own acqure/release function too to make priority
-	 * scheduler correct.
-	 */
+static bool pcp_acquire(int resource_id)
+{
+	if (!prio_acquire(resource_id)) {
+		return false;
+	}
+
+	/* Boost the owner to the ceiling */
+	__set_prio(current, MAX_PRIO);
+	return true;
+}
+
+static void pcp_release(int resource_id)
+{
+	prio_release(resource_id);
+
+	/* Restore the priority when all resources are released */
+	if (!current->nr_held_resources) {
+		__set_prio(current, current->prio_orig);
+	}
+}
+
+const struct scheduler pcp_scheduler = {
+	.name = "Priority + Priority Ceiling Protocol",
+	.acquire = pcp_acquire,
+	.release = pcp_release,
+	.initialize = prio_initialize,
+	.finalize = prio_finalize,
+	.forked = prio_forked,
+	.schedule = prio_schedule,
+	.dump = prio_dump,
+	.steal = prio_steal,
+	.for_each_ready = prio_for_each_ready,
 };
 
-static struct process *pcp_schedule(void)
+
+/***********************************************************************
+ * Priority scheduler with priority inheritance protocol
+ *
+ * Each resource donates the highest priority of its waiters to its owner,
+ * and the owner runs with the highest of its original priority and the
+ * donations. The donations are tallied in @p->donations as they come and
+ * go, and the waitqueue of each resource remembers the
+ * priority it donates in @donated. So neither blocking nor releasing
+ * looks into other resources. When the owner gets a higher priority while
+ * it is waiting for another resource itself, the donation is passed on
+ * along the chain of the owners, up to PIP_MAX_DEPTH hops.
+ ***********************************************************************/
+#define PIP_MAX_DEPTH	8
+
+static void __donate(struct process *p, int prio)
+{
+	struct process_donations *d;
+
+	if (prio < 0) return;
+
+	d = sim_process_donations(p);
+	if (d->nr_donated[prio]++ == 0) {
+		d->donated[prio / 64] |= 1ULL << (prio % 64);
+	}
+}
+
+static void __undonate(struct process *p, int prio)
+{
+	struct process_donations *d = p->donations;
+
+	if (prio < 0) return;
+
+	assert(d && d->nr_donated[prio] > 0);
+	if (--d->nr_donated[prio] == 0) {
+		d->donated[prio / 64] &= ~(1ULL << (prio % 64));
+	}
+}
+
+/**
+ * The priority @p should run with; the highest donated one if it is higher
+ * than the original one
+ */
+static unsigned int __donated_prio(struct process *p)
 {
-    // Declare a pointer to the process with the highest priority
-    struct process *highest_prio = NULL;
-    // Declare a pointer to the current task in the run queue
-    struct process *curr;
+	struct process_donations *d = p->donations;
+
+	if (!d) return p->prio_orig;
 
-    // Iterate through the run queue
-    list_for_each_entry(curr, &runqueue, run_list)
-    {
-        // If the current task has a higher priority than the current highest priority task
-        if (!highest_prio || curr->priority < highest_prio->priority)
-        {
-            // Update the highest priority task pointer
-            highest_prio = curr;
-        }
-    }
+	for (int i = sizeof(d->donated) / sizeof(d->donated[0]) - 1; i >= 0; i--) {
+		if (d->donated[i]) {
+			unsigned int prio = i * 64 + 63 - __builtin_clzll(d->donated[i]);
 
-    // Return the task with the highest priority
-    return highest_prio;
+			return prio > p->prio_orig ? prio : p->prio_orig;
+		}
+	}
+	return p->prio_orig;
 }
 
-static int pcp_acquire(struct process *p)
+/**
+ * Bring the donation of @resource_id to its owner up to date, and pass the
+ * change of the owner's priority on to the resource it is waiting for
+ */
+static void __propagate_donation(int resource_id)
 {
-    // Acquire the lock for the process
-    if (acquire_lock(p->lock) != 0)
-        return -1;
+	for (int depth = 0; depth < PIP_MAX_DEPTH; depth++) {
+		struct resource *r = resources + resource_id;
+		struct prio_waitqueue *wq = sim_prio_waitqueue(resource_id);
+		struct process *owner = r->owner;
+		int top = prio_waitqueue_top(wq);
+		unsigned int prio;
+
+		if (!owner || top == wq->donated) return;
+
+		__undonate(owner, wq->donated);
+		__donate(owner, top);
+		wq->donated = top;
 
-    // Check if the current priority of the process is higher than the priority ceiling
-    if (p->priority < p->lock->ceiling)
-    {
-        // If so, update the priority of the process to the priority ceiling
-        p->priority = p->lock->ceiling;
-    }
+		prio = __donated_prio(owner);
+		if (prio == owner->prio) return;
+
+		__set_prio(owner, prio);
+		if (owner->status != PROCESS_WAIT) return;
+
+		resource_id = owner->waiting_for;
+	}
+}
+
+static bool pip_acquire(int resource_id)
+{
+	if (prio_acquire(resource_id)) {
+		/* Take over the donation from the processes already waiting */
+		__propagate_donation(resource_id);
+		return true;
+	}
 
-    // Return success
-    return 0;
+	/* @current is blocked. Let the owner(s) inherit the priority of current */
+	__propagate_donation(resource_id);
+	return false;
 }
 
-static int pcp_release(struct process *p)
+static void pip_release(int resource_id)
 {
-    // Release the lock for the process
-    release_lock(p->lock);
+	struct prio_waitqueue *wq = sim_prio_waitqueue(resource_id);
 
-    // Restore the original priority of the process
-    p->priority = p->orig_priority;
+	/* The resource does not donate to current anymore */
+	__undonate(current, wq->donated);
+	wq->donated = -1;
 
-    // Return success
-    return 0;
+	prio_release(resource_id);
+
+	__set_prio(current, __donated_prio(current));
 }
 
+const struct scheduler pip_scheduler = {
+	.name = "Priority + Priority Inheritance Protocol",
+	.acquire = pip_acquire,
+	.release = pip_release,
+	.initialize = prio_initialize,
+	.finalize = prio_finalize,
+	.forked = prio_forked,
+	.schedule = prio_schedule,
+	.dump = prio_dump,
+	.steal = prio_steal,
+	.for_each_ready = prio_for_each_ready,
+};
+
+
 /***********************************************************************
- * Priority scheduler with priority inheritance protocol
+ * Completely fair scheduler
+ *
+ * Each process accumulates the virtual runtime @vruntime as it runs, which
+ * is the ticks it has run scaled down by its weight. The weight grows by
+ * about 1.25 times per nice level as in Linux, and the priorities 0 ..
+ * MAX_PRIO are spread over the nice levels 0 .. -20. The ready processes
+ * of each processor are kept in a red-black tree ordered by @vruntime, so
+ * the one with the smallest runs next in O(1), and putting one in and out
+ * costs O(log n). The ties are broken by the order of arrival.
+ *
+ * @current runs until it uses up its share of CFS_LATENCY ticks by its
+ * weight among the ready ones, which is at least CFS_MIN_GRANULARITY ticks.
+ * A forked process starts from @min_vruntime of the run queue, and a woken
+ * up one gets back not earlier than CFS_LATENCY / 2 ticks before it, so
+ * that neither can starve the ones that have been waiting. The vruntime of
+ * a process moved to another processor is shifted by the difference of
+ * their @min_vruntime.
+ *
+ * The checkpoint saves the vruntime and the slice of each process and
+ * @min_vruntime of each processor, so restoring with this scheduler goes on
+ * as if it had not stopped. Restored from another scheduler, the processes
+ * start from @min_vruntime in the order they were to run.
  ***********************************************************************/
-struct scheduler pip_scheduler = {
-	.name = "Priority + Priority Inheritance Protocol",
+#include "rbtree.h"
+
+#define CFS_LATENCY			6	/* Ticks to run every ready process once in */
+#define CFS_MIN_GRANULARITY	1	/* The shortest slice in ticks */
+
+#define NICE_0_LOAD		1024
+#define CFS_TICK		(1ULL << 20)	/* vruntime of a tick at NICE_0_LOAD */
+
+/**
+ * Weights of nice -20 .. 0 from sched_prio_to_weight of Linux
+ */
+static const unsigned int __cfs_weights[] = {
+	/* -20 */ 88761, 71755, 56483, 46273, 36291,
+	/* -15 */ 29154, 23254, 18705, 14949, 11916,
+	/* -10 */  9548,  7620,  6100,  4904,  3906,
+	/*  -5 */  3121,  2501,  1991,  1586,  1277,
+	/*   0 */  1024,
+};
+#define CFS_NR_WEIGHTS	(sizeof(__cfs_weights) / sizeof(__cfs_weights[0]))
+
+struct cfs_rq {
+	struct rb_root_cached tasks;	/* Ready processes by vruntime */
+	unsigned int nr_queued;
+	unsigned long long total_weight;	/* of the processes in @tasks */
+
 	/**
-	 * Ditto
+	 * Monotonic, following the smallest vruntime of the ready ones and
+	 * @current
 	 */
+	unsigned long long min_vruntime;
+
+	struct list_head entities;		/* Entities allocated here */
+};
+
+/**
+ * Scheduling entity of a process, kept in @p->sched_data
+ */
+struct cfs_entity {
+	struct rb_node node;
+	unsigned long long vruntime;
+	unsigned long long vdelta;	/* vruntime of a tick by @weight */
+	unsigned int weight;
+
+	unsigned int charged_age;	/* @p->age when @vruntime is charged last */
+	unsigned int picked_age;	/* @p->age when it is picked to run */
+
+	struct cfs_rq *rq;			/* The run queue @vruntime is relative to */
+	struct process *p;
+	struct list_head list;		/* In @entities of the allocating run queue */
+};
+
+static inline struct cfs_rq *__cfs_rq(void)
+{
+	return this_cpu->sched_data;
+}
+
+/* @a comes before @b. The vruntime may wrap around like the kernel's */
+static inline bool __vruntime_before(unsigned long long a, unsigned long long b)
+{
+	return (long long)(a - b) < 0;
+}
+
+static bool __cfs_less(struct rb_node *a, const struct rb_node *b)
+{
+	return __vruntime_before(rb_entry(a, struct cfs_entity, node)->vruntime,
+			rb_entry(b, struct cfs_entity, node)->vruntime);
+}
+
+static unsigned int __cfs_weight(unsigned int prio)
+{
+	unsigned int nice = (prio * (CFS_NR_WEIGHTS - 1) + MAX_PRIO / 2) / MAX_PRIO;
+
+	if (nice > CFS_NR_WEIGHTS - 1) nice = CFS_NR_WEIGHTS - 1;
+	return __cfs_weights[CFS_NR_WEIGHTS - 1 - nice];
+}
+
+static int cfs_initialize(void)
+{
+	struct cfs_rq *rq = malloc(sizeof(*rq));
+
+	if (!rq) return -1;
+
+	rq->tasks = RB_ROOT_CACHED;
+	rq->nr_queued = 0;
+	rq->total_weight = 0;
+	rq->min_vruntime = 0;
+	INIT_LIST_HEAD(&rq->entities);
+
+	this_cpu->sched_data = rq;
+	return 0;
+}
+
+static void cfs_finalize(void)
+{
+	struct cfs_rq *rq = __cfs_rq();
+	struct cfs_entity *se, *tmp;
+
+	/* Processes may be left waiting for resources at the end */
+	list_for_each_entry_safe(se, tmp, &rq->entities, list) {
+		se->p->sched_data = NULL;
+		free(se);
+	}
+	free(rq);
+	this_cpu->sched_data = NULL;
+}
+
+/**
+ * Add the vruntime @se has earned since charged last, and make it relative
+ * to @rq
+ */
+static void __cfs_charge(struct cfs_rq *rq, struct cfs_entity *se)
+{
+	se->vruntime += (se->p->age - se->charged_age) * se->vdelta;
+	se->charged_age = se->p->age;
+
+	if (se->rq != rq) {
+		se->vruntime += rq->min_vruntime - se->rq->min_vruntime;
+		se->rq = rq;
+	}
+}
+
+static void __cfs_update_min_vruntime(struct cfs_rq *rq, struct cfs_entity *curr)
+{
+	struct rb_node *leftmost = rb_first_cached(&rq->tasks);
+	unsigned long long vruntime;
+
+	if (!curr && !leftmost) return;
+
+	vruntime = curr ? curr->vruntime : rb_entry(leftmost, struct cfs_entity, node)->vruntime;
+	if (curr && leftmost) {
+		struct cfs_entity *se = rb_entry(leftmost, struct cfs_entity, node);
+
+		if (__vruntime_before(se->vruntime, vruntime)) vruntime = se->vruntime;
+	}
+
+	if (__vruntime_before(rq->min_vruntime, vruntime)) rq->min_vruntime = vruntime;
+}
+
+static void __cfs_enqueue_entity(struct cfs_rq *rq, struct cfs_entity *se)
+{
+	rb_add_cached(&se->node, &rq->tasks, __cfs_less);
+	rq->nr_queued++;
+	rq->total_weight += se->weight;
+}
+
+static struct cfs_entity *__cfs_dequeue_first(struct cfs_rq *rq)
+{
+	struct rb_node *leftmost = rb_first_cached(&rq->tasks);
+	struct cfs_entity *se;
+
+	if (!leftmost) return NULL;
+
+	se = rb_entry(leftmost, struct cfs_entity, node);
+	rb_erase_cached(leftmost, &rq->tasks);
+	RB_CLEAR_NODE(leftmost);
+	rq->nr_queued--;
+	rq->total_weight -= se->weight;
+
+	return se;
+}
+
+/**
+ * The entity of @p, which starts from @min_vruntime of @this_cpu. The
+ * processes restored from a snapshot may be running or waiting without
+ * being forked, so they get one when they are seen first
+ */
+static struct cfs_entity *__cfs_entity(struct process *p)
+{
+	struct cfs_rq *rq = __cfs_rq();
+	struct cfs_entity *se = p->sched_data;
+
+	if (se) return se;
+
+	se = malloc(sizeof(*se));
+	if (!se) {
+		fprintf(stderr, "Out of memory while scheduling process %d\n", p->pid);
+		exit(EXIT_FAILURE);
+	}
+
+	se->weight = __cfs_weight(p->prio);
+	se->vdelta = CFS_TICK * NICE_0_LOAD / se->weight;
+	se->vruntime = rq->min_vruntime;
+	se->charged_age = p->age;
+	se->picked_age = p->age;
+	se->rq = rq;
+	se->p = p;
+	list_add_tail(&se->list, &rq->entities);
+	p->sched_data = se;
+
+	return se;
+}
+
+static void cfs_forked(struct process *p)
+{
+	/* The framework put @p into @readyqueue. Take it into the tree */
+	list_del_init(&p->list);
+	__cfs_enqueue_entity(__cfs_rq(), __cfs_entity(p));
+}
+
+static void cfs_exiting(struct process *p)
+{
+	struct cfs_entity *se = p->sched_data;
+
+	if (!se) return;
+
+	list_del(&se->list);
+	free(se);
+	p->sched_data = NULL;
+}
+
+/**
+ * Put the woken-up @p into the run queue of @this_cpu
+ */
+static void __cfs_enqueue_woken(struct process *p)
+{
+	struct cfs_rq *rq = __cfs_rq();
+	struct cfs_entity *se = __cfs_entity(p);
+	unsigned long long vruntime = rq->min_vruntime - CFS_LATENCY * CFS_TICK / 2;
+
+	__cfs_charge(rq, se);
+
+	/* Do not let it bring back too much credit from the sleep */
+	if (__vruntime_before(se->vruntime, vruntime)) se->vruntime = vruntime;
+
+	__cfs_enqueue_entity(rq, se);
+}
+
+static void cfs_release(int resource_id)
+{
+	struct process *waiter = __fcfs_wake_up(resource_id);
+
+	if (waiter) __enqueue_woken(waiter, __cfs_enqueue_woken);
+}
+
+/**
+ * Ticks that @se may run for in a row, in proportion to its weight among
+ * the ready ones
+ */
+static unsigned int __cfs_slice(struct cfs_rq *rq, struct cfs_entity *se)
+{
+	unsigned int slice = CFS_LATENCY * se->weight / (rq->total_weight + se->weight);
+
+	return slice > CFS_MIN_GRANULARITY ? slice : CFS_MIN_GRANULARITY;
+}
+
+static struct process *cfs_schedule(void)
+{
+	struct cfs_rq *rq = __cfs_rq();
+	struct cfs_entity *se = current ? __cfs_entity(current) : NULL;
+
+	if (se) __cfs_charge(rq, se);
+
+	if (se && current->status != PROCESS_WAIT &&
+			current->age < current->lifespan) {
+		/* Keep running @current for its slice */
+		if (!rq->nr_queued ||
+				current->age - se->picked_age < __cfs_slice(rq, se)) {
+			__cfs_update_min_vruntime(rq, se);
+			return current;
+		}
+		__cfs_enqueue_entity(rq, se);
+	}
+
+	se = __cfs_dequeue_first(rq);
+	__cfs_update_min_vruntime(rq, se);
+	if (!se) return NULL;
+
+	se->picked_age = se->p->age;
+	return se->p;
+}
+
+static void cfs_dump(void)
+{
+	for (struct rb_node *node = rb_first_cached(&__cfs_rq()->tasks); node;
+			node = rb_next(node)) {
+		dump_process(rb_entry(node, struct cfs_entity, node)->p);
+	}
+}
+
+static void cfs_for_each_ready(void (*fn)(struct process *, void *), void *data)
+{
+	for (struct rb_node *node = rb_first_cached(&__cfs_rq()->tasks); node;
+			node = rb_next(node)) {
+		fn(rb_entry(node, struct cfs_entity, node)->p, data);
+	}
+}
+
+/**
+ * Give the one that has waited the longest to an idle processor. Its
+ * vruntime is made relative to the run queue there when it is scheduled
+ */
+static struct process *cfs_steal(void)
+{
+	struct cfs_entity *se = __cfs_dequeue_first(__cfs_rq());
+
+	if (!se) return NULL;
+
+	se->picked_age = se->p->age;
+	return se->p;
+}
+
+/**
+ * The cfs_rq @se is relative to is saved by the processor, as the stolen
+ * ones keep that of the processor they come from until they are charged
+ */
+static bool cfs_save(struct process *p, unsigned long long state[])
+{
+	struct cfs_entity *se;
+	unsigned int cpu = 0;
+
+	if (!p) {
+		state[0] = __cfs_rq()->min_vruntime;
+		return true;
+	}
+
+	se = p->sched_data;
+	if (!se) return false;
+
+	while (this_sim->cpus[cpu].sched_data != se->rq) cpu++;
+
+	state[0] = se->vruntime + (p->age - se->charged_age) * se->vdelta;
+	state[1] = p->age - se->picked_age;
+	state[2] = cpu;
+	return true;
+}
+
+static void cfs_restore(struct process *p, const unsigned long long state[])
+{
+	struct cfs_entity *se;
+
+	if (!p) {
+		__cfs_rq()->min_vruntime = state[0];
+		return;
+	}
+
+	se = __cfs_entity(p);
+	se->vruntime = state[0];
+	if (state[1] <= p->age) se->picked_age = p->age - state[1];
+	if (state[2] < this_sim->nr_cpus) se->rq = this_sim->cpus[state[2]].sched_data;
+}
+
+const struct scheduler cfs_scheduler = {
+	.name = "Completely Fair",
+	.acquire = fcfs_acquire, /* Use the default FCFS acquire() */
+	.release = cfs_release,
+	.initialize = cfs_initialize,
+	.finalize = cfs_finalize,
+	.forked = cfs_forked,
+	.exiting = cfs_exiting,
+	.schedule = cfs_schedule,
+	.dump = cfs_dump,
+	.steal = cfs_steal,
+	.for_each_ready = cfs_for_each_ready,
+	.save = cfs_save,
+	.restore = cfs_restore,
 };
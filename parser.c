@@ -51,3 +51,68 @@ int parse_command(char *command, int *nr_tokens, char *tokens[])
 
 	return (*nr_tokens > 0);
 }
+
+
+static inline int __is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+int scan_tokens(const char **pos, const char *end,
+		struct token tokens[], int max_tokens)
+{
+	const char *curr = *pos;
+	int nr_tokens = 0;
+
+	while (curr < end && *curr != '\n') {
+		const char *start;
+
+		if (__is_blank(*curr)) {
+			curr++;
+			continue;
+		}
+
+		/* Remove comments */
+		if (*curr == '#') {
+			while (curr < end && *curr != '\n') curr++;
+			break;
+		}
+
+		start = curr;
+		while (curr < end && *curr != '\n' && !__is_blank(*curr)) curr++;
+
+		if (nr_tokens < max_tokens) {
+			tokens[nr_tokens].str = start;
+			tokens[nr_tokens].len = curr - start;
+		}
+		nr_tokens++;
+	}
+
+	/* Skip the newline */
+	*pos = curr < end ? curr + 1 : end;
+
+	return nr_tokens;
+}
+
+int parse_int(const struct token *token, int *value)
+{
+	const char *str = token->str;
+	const char *end = token->str + token->len;
+	bool negative = false;
+	unsigned int v = 0;
+
+	if (str < end && (*str == '-' || *str == '+')) {
+		negative = *str == '-';
+		str++;
+	}
+	if (str == end) return 0;
+
+	for (; str < end; str++) {
+		unsigned int digit = *str - '0';
+		if (digit > 9) return 0;
+		v = v * 10 + digit;
+	}
+
+	*value = negative ? -(int)v : (int)v;
+	return 1;
+}
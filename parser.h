@@ -47,4 +47,43 @@
  */
 int parse_command(char *command, int *nr_tokens, char *tokens[]);
 
+
+/**
+ * A token in a buffer. It is not null-terminated, so use @len
+ */
+struct token {
+	const char *str;
+	unsigned int len;
+};
+
+/***********************************************************************
+ * scan_tokens()
+ *
+ * DESCRIPTION
+ *  Zero-copy variant of parse_command(). Scan a line from @*pos in the
+ *  buffer ending at @end, put up to @max_tokens tokens into @tokens[], and
+ *  advance @*pos to the beginning of the next line. The buffer is not
+ *  modified, and the line can be arbitrarily long. The comment starting
+ *  with # is removed as parse_command() does.
+ *
+ * RETURN VALUE
+ *  Return the number of tokens in the line, which can be larger than
+ *  @max_tokens if the line has more tokens than that.
+ */
+int scan_tokens(const char **pos, const char *end,
+		struct token tokens[], int max_tokens);
+
+
+/***********************************************************************
+ * parse_int()
+ *
+ * DESCRIPTION
+ *  Convert @token into an integer and put it to @value.
+ *
+ * RETURN VALUE
+ *  Return 1 if @token is a decimal integer with an optional sign
+ *  Return 0 otherwise
+ */
+int parse_int(const struct token *token, int *value);
+
 #endif
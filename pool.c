@@ -0,0 +1,131 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+
+#include "pool.h"
+
+struct pool_slab {
+	struct pool_slab *next;
+};
+
+/* Objects are aligned to the largest basic type */
+#define POOL_ALIGN	(sizeof(long long) > sizeof(void *) ? sizeof(long long) : sizeof(void *))
+#define __round_up(x, align)	(((x) + (align) - 1) / (align) * (align))
+
+void pool_init(struct pool *pool, const char *name, size_t object_size)
+{
+	pool->name = name;
+	pool->object_size = __round_up(object_size, POOL_ALIGN);
+	pool->slab_size = POOL_SLAB_SIZE;
+	if (pool->slab_size < pool->object_size * 16) {
+		pool->slab_size = pool->object_size * 16;
+	}
+
+	pool->freelist = NULL;
+	pool->cursor = pool->limit = NULL;
+	pool->slabs = NULL;
+
+	pool->nr_live = pool->nr_peak = pool->nr_slabs = 0;
+}
+
+static int __grow(struct pool *pool)
+{
+	size_t header = __round_up(sizeof(struct pool_slab), POOL_ALIGN);
+	struct pool_slab *slab = malloc(header + pool->slab_size);
+
+	if (!slab) return -1;
+
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+	pool->nr_slabs++;
+
+	pool->cursor = (char *)slab + header;
+	pool->limit = pool->cursor + pool->slab_size;
+
+	return 0;
+}
+
+void *pool_alloc(struct pool *pool)
+{
+	void *object;
+
+	if (pool->freelist) {
+		object = pool->freelist;
+		pool->freelist = *(void **)object;
+	} else {
+		if (pool->cursor + pool->object_size > pool->limit && __grow(pool)) {
+			return NULL;
+		}
+		object = pool->cursor;
+		pool->cursor += pool->object_size;
+	}
+
+	if (++pool->nr_live > pool->nr_peak) {
+		pool->nr_peak = pool->nr_live;
+	}
+	return object;
+}
+
+void pool_free(struct pool *pool, void *object)
+{
+	*(void **)object = pool->freelist;
+	pool->freelist = object;
+	pool->nr_live--;
+}
+
+void pool_merge(struct pool *pool, struct pool *from)
+{
+	if (from->slabs) {
+		struct pool_slab *tail = from->slabs;
+
+		while (tail->next) tail = tail->next;
+		tail->next = pool->slabs;
+		pool->slabs = from->slabs;
+	}
+
+	if (from->freelist) {
+		void **tail = from->freelist;
+
+		while (*tail) tail = *tail;
+		*tail = pool->freelist;
+		pool->freelist = from->freelist;
+	}
+
+	pool->nr_slabs += from->nr_slabs;
+	pool->nr_live += from->nr_live;
+	if (pool->nr_live > pool->nr_peak) {
+		pool->nr_peak = pool->nr_live;
+	}
+
+	from->freelist = NULL;
+	from->cursor = from->limit = NULL;
+	from->slabs = NULL;
+	from->nr_live = from->nr_peak = from->nr_slabs = 0;
+}
+
+void pool_destroy(struct pool *pool)
+{
+	while (pool->slabs) {
+		struct pool_slab *slab = pool->slabs;
+		pool->slabs = slab->next;
+		free(slab);
+	}
+
+	pool->freelist = NULL;
+	pool->cursor = pool->limit = NULL;
+	pool->nr_live = 0;
+	pool->nr_slabs = 0;
+}
@@ -0,0 +1,92 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stddef.h>
+
+/**
+ * Pool of fixed-size objects. Objects are carved out of large slabs, and
+ * freed objects are kept in a freelist to be reused by following
+ * allocations. All slabs are released at once by pool_destroy().
+ */
+struct pool_slab;
+
+struct pool {
+	const char *name;
+	size_t object_size;
+	size_t slab_size;
+
+	void *freelist;			/* Freed objects, linked through their first word */
+	char *cursor;			/* Next never-used object in the latest slab */
+	char *limit;
+	struct pool_slab *slabs;
+
+	unsigned long nr_live;	/* # of objects allocated and not freed */
+	unsigned long nr_peak;	/* Max of @nr_live ever */
+	unsigned long nr_slabs;
+};
+
+#define POOL_SLAB_SIZE	(1 << 16)
+
+/***********************************************************************
+ * pool_init()
+ *
+ * DESCRIPTION
+ *   Initialize @pool of objects with @object_size bytes. @name is used to
+ *   report the statistics.
+ */
+void pool_init(struct pool *pool, const char *name, size_t object_size);
+
+/***********************************************************************
+ * pool_alloc()
+ *
+ * DESCRIPTION
+ *   Allocate an object from @pool. The object is not initialized.
+ *
+ * RETURN
+ *   The object, or NULL if running out of memory
+ */
+void *pool_alloc(struct pool *pool);
+
+/***********************************************************************
+ * pool_free()
+ *
+ * DESCRIPTION
+ *   Return @object to @pool for reuse.
+ */
+void pool_free(struct pool *pool, void *object);
+
+/***********************************************************************
+ * pool_merge()
+ *
+ * DESCRIPTION
+ *   Move all slabs and objects of @from into @pool of the same object size,
+ *   leaving @from empty. The objects allocated from @from can be freed to
+ *   @pool afterwards. The rest of the latest slab of @from is not used.
+ */
+void pool_merge(struct pool *pool, struct pool *from);
+
+/***********************************************************************
+ * pool_destroy()
+ *
+ * DESCRIPTION
+ *   Release all slabs of @pool at once, including the objects that are not
+ *   freed yet.
+ */
+void pool_destroy(struct pool *pool);
+
+#endif
@@ -0,0 +1,139 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __PRIO_ARRAY_H__
+#define __PRIO_ARRAY_H__
+
+#include <assert.h>
+
+#include "list_head.h"
+#include "process.h"
+
+/**
+ * Priority-indexed run queue in the style of the O(1) scheduler of the
+ * Linux kernel 2.6. Each priority level has its own FIFO list, and the
+ * occupancy of the levels is tracked with a bitmap so that the highest
+ * priority level can be found with a find-first-set instruction.
+ *
+ * Valid priority levels are 0 .. MAX_PRIO (inclusive) since the priority
+ * ceiling protocol boosts processes to MAX_PRIO. Thus the bitmap spans two
+ * 64-bit words, which keeps the search constant-time.
+ */
+#define PRIO_ARRAY_LEVELS	(MAX_PRIO + 1)
+#define PRIO_ARRAY_WORDS	((PRIO_ARRAY_LEVELS + 63) / 64)
+
+struct prio_array {
+	unsigned int nr_active;	/* # of processes in the array */
+	unsigned long long bitmap[PRIO_ARRAY_WORDS];
+							/* Bit n is set if queue[n] is not empty */
+	struct list_head queue[PRIO_ARRAY_LEVELS];
+};
+
+static inline void prio_array_init(struct prio_array *array)
+{
+	array->nr_active = 0;
+	for (int i = 0; i < PRIO_ARRAY_WORDS; i++) {
+		array->bitmap[i] = 0;
+	}
+	for (int i = 0; i < PRIO_ARRAY_LEVELS; i++) {
+		INIT_LIST_HEAD(array->queue + i);
+	}
+}
+
+static inline int prio_array_empty(struct prio_array *array)
+{
+	return array->nr_active == 0;
+}
+
+/**
+ * prio_array_enqueue - put @p at the tail of its priority level
+ */
+static inline void prio_array_enqueue(struct prio_array *array, struct process *p)
+{
+	unsigned int prio = p->prio;
+
+	assert(prio < PRIO_ARRAY_LEVELS);
+
+	list_add_tail(&p->list, array->queue + prio);
+	array->bitmap[prio / 64] |= 1ULL << (prio % 64);
+	array->nr_active++;
+}
+
+/**
+ * prio_array_enqueue_head - put @p at the head of its priority level
+ */
+static inline void prio_array_enqueue_head(struct prio_array *array, struct process *p)
+{
+	unsigned int prio = p->prio;
+
+	assert(prio < PRIO_ARRAY_LEVELS);
+
+	list_add(&p->list, array->queue + prio);
+	array->bitmap[prio / 64] |= 1ULL << (prio % 64);
+	array->nr_active++;
+}
+
+/**
+ * prio_array_dequeue - detach @p from the array
+ *
+ * @p->prio should not be changed while it is in the array. Dequeue it,
+ * update the priority, and enqueue it again.
+ */
+static inline void prio_array_dequeue(struct prio_array *array, struct process *p)
+{
+	unsigned int prio = p->prio;
+
+	list_del_init(&p->list);
+	if (list_empty(array->queue + prio)) {
+		array->bitmap[prio / 64] &= ~(1ULL << (prio % 64));
+	}
+	array->nr_active--;
+}
+
+/**
+ * prio_array_top - the highest priority level with a process, or -1 if empty
+ */
+static inline int prio_array_top(struct prio_array *array)
+{
+	for (int i = PRIO_ARRAY_WORDS - 1; i >= 0; i--) {
+		if (array->bitmap[i]) {
+			return i * 64 + 63 - __builtin_clzll(array->bitmap[i]);
+		}
+	}
+	return -1;
+}
+
+/**
+ * prio_array_first - the process that came first among the ones with the
+ * highest priority, or NULL if the array is empty
+ */
+static inline struct process *prio_array_first(struct prio_array *array)
+{
+	int prio = prio_array_top(array);
+
+	if (prio < 0) return NULL;
+
+	return list_first_entry(array->queue + prio, struct process, list);
+}
+
+/**
+ * prio_array_for_each_entry - iterate the processes from the highest priority
+ * level to the lowest one, in the FIFO order within each level
+ */
+#define prio_array_for_each_entry(pos, array, __prio) \
+	for (__prio = PRIO_ARRAY_LEVELS - 1; __prio >= 0; __prio--) \
+		list_for_each_entry(pos, (array)->queue + __prio, list)
+
+#endif
@@ -0,0 +1,116 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __PRIO_WAITQUEUE_H__
+#define __PRIO_WAITQUEUE_H__
+
+#include "list_head.h"
+#include "process.h"
+#include "prio_array.h"
+
+/**
+ * Waitqueue of a resource that gives out the resource in the priority order.
+ * The waiters are kept in a priority-indexed array (see prio_array.h), so
+ * the highest-priority waiter is found in O(1). Waiters with the same
+ * priority are served in the order they came to the waitqueue, even after
+ * their priorities are changed while waiting.
+ *
+ * The waitqueue of a resource is allocated on demand with
+ * sim_prio_waitqueue(), and is released with the simulation.
+ */
+struct prio_waitqueue {
+	struct prio_array waiters;
+	unsigned long long nr_arrivals;	/* To number the waiters in @wait_order */
+	int donated;		/* The priority donated to the owner, or -1 */
+};
+
+static inline void prio_waitqueue_init(struct prio_waitqueue *wq)
+{
+	prio_array_init(&wq->waiters);
+	wq->nr_arrivals = 0;
+	wq->donated = -1;
+}
+
+static inline int prio_waitqueue_empty(struct prio_waitqueue *wq)
+{
+	return prio_array_empty(&wq->waiters);
+}
+
+/**
+ * Put @p, with its wait_order numbered already, into its priority level,
+ * after the waiters that came earlier
+ */
+static inline void __prio_waitqueue_insert(struct prio_waitqueue *wq,
+		struct process *p)
+{
+	struct list_head *level = wq->waiters.queue + p->prio;
+
+	prio_array_enqueue(&wq->waiters, p);
+
+	while (p->list.prev != level &&
+			list_entry(p->list.prev, struct process, list)->wait_order > p->wait_order) {
+		list_move(&p->list, p->list.prev->prev);
+	}
+}
+
+/**
+ * prio_waitqueue_add - let @p wait at the end of the line
+ */
+static inline void prio_waitqueue_add(struct prio_waitqueue *wq, struct process *p)
+{
+	p->wait_order = wq->nr_arrivals++;
+	__prio_waitqueue_insert(wq, p);
+}
+
+/**
+ * prio_waitqueue_del - take @p out of the waitqueue
+ */
+static inline void prio_waitqueue_del(struct prio_waitqueue *wq, struct process *p)
+{
+	prio_array_dequeue(&wq->waiters, p);
+}
+
+/**
+ * prio_waitqueue_set_prio - change the priority of waiting @p, keeping its
+ * place in the line among the waiters of the new priority
+ */
+static inline void prio_waitqueue_set_prio(struct prio_waitqueue *wq,
+		struct process *p, unsigned int prio)
+{
+	prio_array_dequeue(&wq->waiters, p);
+	p->prio = prio;
+	__prio_waitqueue_insert(wq, p);
+}
+
+/**
+ * prio_waitqueue_first - the waiter to give the resource to next, or NULL
+ */
+static inline struct process *prio_waitqueue_first(struct prio_waitqueue *wq)
+{
+	return prio_array_first(&wq->waiters);
+}
+
+/**
+ * prio_waitqueue_top - the highest priority among the waiters, or -1
+ */
+static inline int prio_waitqueue_top(struct prio_waitqueue *wq)
+{
+	return prio_array_top(&wq->waiters);
+}
+
+#define prio_waitqueue_for_each_entry(pos, wq, __prio) \
+	prio_array_for_each_entry(pos, &(wq)->waiters, __prio)
+
+#endif
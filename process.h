@@ -18,6 +18,8 @@
 
 struct list_head;
 
+#define MAX_PRIO	64	/* Maximum value for priority */
+
 enum process_status {
 	PROCESS_READY,		/* Process is ready to run */
 	PROCESS_RUNNING,	/* The process is now running */
@@ -25,6 +27,30 @@ enum process_status {
 	PROCESS_EXIT,		/* The process is exited */
 };
 
+/**
+ * Priorities donated to a process through the resources it is holding.
+ * @nr_donated[prio] is the number of the held resources that donate @prio,
+ * and bit prio of @donated is set if it is not zero.
+ */
+struct process_donations {
+	unsigned long long donated[(MAX_PRIO + 64) / 64];
+	unsigned short nr_donated[MAX_PRIO + 1];
+};
+
+struct process_metrics;
+
+/**
+ * The fields that the schedulers look at while walking their run queues come
+ * first, so that they share a cache line with @list. The ones used by a few
+ * schedulers or while the process is running follow, and whatever is not
+ * needed by every process is kept aside and pointed to.
+ *
+ * The processes are still linked through @list; keeping the hot fields in
+ * arrays indexed by 32-bit slot ids is deferred. In the scripts of make bench
+ * no more than 15 processes are ready on a processor at once, so walking the
+ * run queues costs little there. Workloads with many thousands of ready
+ * processes would still chase a pointer per process.
+ */
 struct process {
 	unsigned int pid;		/* Process ID */
 
@@ -39,6 +65,8 @@ struct process {
 							   0 by default, and the larger, the more important
 							   process it is */
 
+	unsigned int cpu;		/* The processor the process is on */
+
 	struct list_head list;	/* list head for listing processes */
 
 	/**
@@ -46,6 +74,31 @@ struct process {
 	 */
 	unsigned int prio_orig;	/* The original priority of the process */
 
+	int waiting_for;		/* The resource the process is waiting for */
+	unsigned long long wait_order;
+							/* The order of arrival to the waitqueue */
+
+	struct process_donations *donations;
+							/* NULL until sim_process_donations() is called */
+
+	/**
+	 * Private data of the scheduler for this process. NULL when forked. The
+	 * scheduler may set it in its forked() callback and release it in
+	 * exiting(). The processes restored running or waiting are not forked
+	 * again, so they reach the scheduler with NULL here.
+	 */
+	void *sched_data;
+
+	/**
+	 * Ids of the resources that the process is holding, in the ascending
+	 * order. The framework keeps these up to date; a resource is added when
+	 * acquire() grants it, and is taken out right before release() is called
+	 * for it. Thus the scheduler need not scan the resource table to find
+	 * what the process is holding.
+	 */
+	int *held_resources;
+	unsigned int nr_held_resources;
+
 
 	/* DO NOT ACCESS FOLLOWING VARIABLES */
 	unsigned int __starts_at;	/* When to fork the process */
@@ -55,13 +108,15 @@ struct process {
 
 	struct list_head __resources_holding;
 								/* Resources that the process is currently holding */
+
+	/* Scheduling metrics from fork to exit, if the simulation collects them */
+	struct process_metrics *__metrics;
 };
 
 /**
  * Support function to dump the process and resource status
  */
 void dump_status(void);
-
-#define MAX_PRIO	64	/* Maximum value for priority */
+void dump_process(struct process *p);
 
 #endif
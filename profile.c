@@ -0,0 +1,185 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "types.h"
+#include "list_head.h"
+#include "process.h"
+#include "sched.h"
+#include "sim.h"
+#include "profile.h"
+
+/**
+ * The time stamp counter where available, as it costs a few cycles to read.
+ * Otherwise the monotonic clock in nanoseconds
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define PROFILE_UNIT	"cycles"
+
+static inline unsigned long long __profile_clock(void)
+{
+	return __builtin_ia32_rdtsc();
+}
+#else
+#define PROFILE_UNIT	"ns"
+
+static inline unsigned long long __profile_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+static const char * const __callback_names[] = {
+	"forked",
+	"exiting",
+	"schedule",
+	"acquire",
+	"release",
+	"select_cpu",
+	"steal",
+};
+
+static inline unsigned int __depth_class(unsigned int depth)
+{
+	unsigned int class;
+
+	if (!depth) return 0;
+
+	class = 32 - __builtin_clz(depth);
+	return class < NR_PROFILE_DEPTHS ? class : NR_PROFILE_DEPTHS - 1;
+}
+
+/**
+ * Time @call to the callback @cb of the scheduler being profiled
+ */
+#define __profile(cb, call) ({ \
+	struct sim_profile *__p = this_sim->__profile; \
+	unsigned int __class = __depth_class(this_cpu->nr_running); \
+	unsigned long long __begin = __profile_clock(); \
+	__typeof__(call) __ret = call; \
+	histogram_add(&__p->costs[cb][__class], __profile_clock() - __begin); \
+	__ret; })
+
+#define __profile_void(cb, call) do { \
+	struct sim_profile *__p = this_sim->__profile; \
+	unsigned int __class = __depth_class(this_cpu->nr_running); \
+	unsigned long long __begin = __profile_clock(); \
+	call; \
+	histogram_add(&__p->costs[cb][__class], __profile_clock() - __begin); \
+} while (0)
+
+#define __target	(this_sim->__profile->target)
+
+static void __profile_forked(struct process *p)
+{
+	__profile_void(PROFILE_FORKED, __target->forked(p));
+}
+
+static void __profile_exiting(struct process *p)
+{
+	__profile_void(PROFILE_EXITING, __target->exiting(p));
+}
+
+static struct process *__profile_schedule(void)
+{
+	return __profile(PROFILE_SCHEDULE, __target->schedule());
+}
+
+static bool __profile_acquire(int resource_id)
+{
+	return __profile(PROFILE_ACQUIRE, __target->acquire(resource_id));
+}
+
+static void __profile_release(int resource_id)
+{
+	__profile_void(PROFILE_RELEASE, __target->release(resource_id));
+}
+
+static int __profile_select_cpu(struct process *p, bool wakeup)
+{
+	return __profile(PROFILE_SELECT_CPU, __target->select_cpu(p, wakeup));
+}
+
+static struct process *__profile_steal(void)
+{
+	return __profile(PROFILE_STEAL, __target->steal());
+}
+
+struct sim_profile *profile_create(const struct scheduler *target)
+{
+	struct sim_profile *profile = malloc(sizeof(*profile));
+
+	if (!profile) return NULL;
+
+	profile->target = target;
+	for (int i = 0; i < NR_PROFILE_CALLBACKS; i++) {
+		for (int j = 0; j < NR_PROFILE_DEPTHS; j++) {
+			histogram_init(&profile->costs[i][j]);
+		}
+	}
+
+	/* Wrap the callbacks the scheduler has. NULL ones are left NULL */
+	profile->sched = *target;
+	if (target->forked) profile->sched.forked = __profile_forked;
+	if (target->exiting) profile->sched.exiting = __profile_exiting;
+	profile->sched.schedule = __profile_schedule;
+	if (target->acquire) profile->sched.acquire = __profile_acquire;
+	if (target->release) profile->sched.release = __profile_release;
+	if (target->select_cpu) profile->sched.select_cpu = __profile_select_cpu;
+	if (target->steal) profile->sched.steal = __profile_steal;
+
+	return profile;
+}
+
+void profile_report(struct sim_profile *profile)
+{
+	printf("\n");
+	printf("Profile of %s scheduler (in %s):\n", profile->target->name, PROFILE_UNIT);
+	printf("  %-10s %11s %12s %12s %10s %10s %10s %10s\n",
+			"Callback", "Runnable", "Calls", "Mean", "p50", "p99", "p99.9", "Max");
+
+	for (int i = 0; i < NR_PROFILE_CALLBACKS; i++) {
+		for (int j = 0; j < NR_PROFILE_DEPTHS; j++) {
+			struct histogram *h = &profile->costs[i][j];
+			char depth[16];
+
+			if (!h->nr) continue;
+
+			if (j <= 1) {
+				snprintf(depth, sizeof(depth), "%d", j);
+			} else if (j == NR_PROFILE_DEPTHS - 1) {
+				snprintf(depth, sizeof(depth), "%u-", 1U << (j - 1));
+			} else {
+				snprintf(depth, sizeof(depth), "%u-%u", 1U << (j - 1), (1U << j) - 1);
+			}
+
+			printf("  %-10s %11s %12llu %12.1f %10llu %10llu %10llu %10llu\n",
+					__callback_names[i], depth, h->nr, histogram_mean(h),
+					histogram_percentile(h, 50), histogram_percentile(h, 99),
+					histogram_percentile(h, 99.9), h->max);
+		}
+	}
+}
+
+void profile_destroy(struct sim_profile *profile)
+{
+	free(profile);
+}
@@ -0,0 +1,78 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "types.h"
+#include "histogram.h"
+
+struct process;
+
+#include "sched.h"
+
+/**
+ * Profile of the scheduler callbacks. The simulation calls the callbacks
+ * through @sched, a copy of the profiled scheduler whose callbacks are
+ * replaced with wrappers timing the real ones. So nothing is added to the
+ * simulation when the profile is off.
+ *
+ * The cost of each call is counted into the histogram for the callback and
+ * the number of processes runnable on the processor (@nr_running of the
+ * processor) at the call, in power-of-two classes; 0, 1, 2-3, 4-7, ...
+ */
+enum profile_callback {
+	PROFILE_FORKED,
+	PROFILE_EXITING,
+	PROFILE_SCHEDULE,
+	PROFILE_ACQUIRE,
+	PROFILE_RELEASE,
+	PROFILE_SELECT_CPU,
+	PROFILE_STEAL,
+	NR_PROFILE_CALLBACKS,
+};
+
+#define NR_PROFILE_DEPTHS	16	/* The last class covers the deeper ones */
+
+struct sim_profile {
+	struct scheduler sched;		/* To install into the simulation */
+	const struct scheduler *target;	/* The one being profiled */
+
+	struct histogram costs[NR_PROFILE_CALLBACKS][NR_PROFILE_DEPTHS];
+};
+
+/***********************************************************************
+ * profile_create()
+ *
+ * DESCRIPTION
+ *   Create the profile of @target. Install @sched of the profile into the
+ *   simulation in place of @target.
+ *
+ * RETURN
+ *   The profile, or NULL if running out of memory
+ */
+struct sim_profile *profile_create(const struct scheduler *target);
+
+/***********************************************************************
+ * profile_report()
+ *
+ * DESCRIPTION
+ *   Print the costs of the callbacks to the standard output.
+ */
+void profile_report(struct sim_profile *profile);
+
+void profile_destroy(struct sim_profile *profile);
+
+#endif
@@ -0,0 +1,441 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+
+#include "types.h"
+#include "list_head.h"
+#include "rbtree.h"
+
+/**
+ * Red-black tree rebalancing after the Linux kernel (lib/rbtree.c). The
+ * rules kept are:
+ *
+ *  1) A node is either red or black
+ *  2) The root is black
+ *  3) All leaves (NULL) are black
+ *  4) Both children of every red node are black
+ *  5) Every simple path from the root to the leaves has the same number of
+ *     black nodes
+ *
+ * So the longest path is no longer than twice the shortest one, which
+ * bounds the operations at O(log n).
+ */
+#define RB_RED		0
+#define RB_BLACK	1
+
+#define __rb_parent(pc)		((struct rb_node *)((pc) & ~3))
+#define __rb_color(pc)		((pc) & 1)
+#define __rb_is_black(pc)	__rb_color(pc)
+#define rb_is_red(rb)		(!__rb_color((rb)->__rb_parent_color))
+#define rb_is_black(rb)		__rb_color((rb)->__rb_parent_color)
+
+static inline void rb_set_parent(struct rb_node *rb, struct rb_node *p)
+{
+	rb->__rb_parent_color = __rb_color(rb->__rb_parent_color) | (unsigned long)p;
+}
+
+static inline void rb_set_parent_color(struct rb_node *rb, struct rb_node *p,
+		int color)
+{
+	rb->__rb_parent_color = (unsigned long)p | color;
+}
+
+static inline void rb_set_black(struct rb_node *rb)
+{
+	rb->__rb_parent_color |= RB_BLACK;
+}
+
+/* The parent of a red node, whose color bit is 0 */
+static inline struct rb_node *rb_red_parent(struct rb_node *red)
+{
+	return (struct rb_node *)red->__rb_parent_color;
+}
+
+static inline void __rb_change_child(struct rb_node *old, struct rb_node *new,
+		struct rb_node *parent, struct rb_root *root)
+{
+	if (parent) {
+		if (parent->rb_left == old) {
+			parent->rb_left = new;
+		} else {
+			parent->rb_right = new;
+		}
+	} else {
+		root->rb_node = new;
+	}
+}
+
+/**
+ * Helper for rotations; @new takes the place and the color of @old, and
+ * @old becomes a child of @new with @color
+ */
+static inline void __rb_rotate_set_parents(struct rb_node *old,
+		struct rb_node *new, struct rb_root *root, int color)
+{
+	struct rb_node *parent = rb_parent(old);
+
+	new->__rb_parent_color = old->__rb_parent_color;
+	rb_set_parent_color(old, new, color);
+	__rb_change_child(old, new, parent, root);
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *parent = rb_red_parent(node), *gparent, *tmp;
+
+	while (true) {
+		/**
+		 * Loop invariant: @node is red. The inserted node is, and the
+		 * color flips in case 1 make the grandparent red
+		 */
+		if (!parent) {
+			/* @node is the root. Make it black */
+			rb_set_parent_color(node, NULL, RB_BLACK);
+			break;
+		}
+
+		/* No two red nodes in a row. Done */
+		if (rb_is_black(parent)) break;
+
+		gparent = rb_red_parent(parent);
+
+		tmp = gparent->rb_right;
+		if (parent != tmp) {	/* parent == gparent->rb_left */
+			if (tmp && rb_is_red(tmp)) {
+				/**
+				 * Case 1 - the uncle is red. Flip the colors of the
+				 * parent, the uncle, and the grandparent, and go on
+				 * from the grandparent
+				 */
+				rb_set_parent_color(tmp, gparent, RB_BLACK);
+				rb_set_parent_color(parent, gparent, RB_BLACK);
+				node = gparent;
+				parent = rb_parent(node);
+				rb_set_parent_color(node, parent, RB_RED);
+				continue;
+			}
+
+			tmp = parent->rb_right;
+			if (node == tmp) {
+				/**
+				 * Case 2 - the uncle is black and @node is the right
+				 * child. Left rotate at the parent to fall into case 3
+				 */
+				tmp = node->rb_left;
+				parent->rb_right = tmp;
+				node->rb_left = parent;
+				if (tmp) rb_set_parent_color(tmp, parent, RB_BLACK);
+				rb_set_parent_color(parent, node, RB_RED);
+				parent = node;
+				tmp = node->rb_right;
+			}
+
+			/**
+			 * Case 3 - the uncle is black and @node is the left child.
+			 * Right rotate at the grandparent
+			 */
+			gparent->rb_left = tmp;	/* == parent->rb_right */
+			parent->rb_right = gparent;
+			if (tmp) rb_set_parent_color(tmp, gparent, RB_BLACK);
+			__rb_rotate_set_parents(gparent, parent, root, RB_RED);
+			break;
+		} else {
+			/* Mirror of the above */
+			tmp = gparent->rb_left;
+			if (tmp && rb_is_red(tmp)) {
+				rb_set_parent_color(tmp, gparent, RB_BLACK);
+				rb_set_parent_color(parent, gparent, RB_BLACK);
+				node = gparent;
+				parent = rb_parent(node);
+				rb_set_parent_color(node, parent, RB_RED);
+				continue;
+			}
+
+			tmp = parent->rb_left;
+			if (node == tmp) {
+				tmp = node->rb_right;
+				parent->rb_left = tmp;
+				node->rb_right = parent;
+				if (tmp) rb_set_parent_color(tmp, parent, RB_BLACK);
+				rb_set_parent_color(parent, node, RB_RED);
+				parent = node;
+				tmp = node->rb_left;
+			}
+
+			gparent->rb_right = tmp;	/* == parent->rb_left */
+			parent->rb_left = gparent;
+			if (tmp) rb_set_parent_color(tmp, gparent, RB_BLACK);
+			__rb_rotate_set_parents(gparent, parent, root, RB_RED);
+			break;
+		}
+	}
+}
+
+/**
+ * Rebalance after a black node is taken out from under @parent, which
+ * leaves the paths through @parent and its (new) child one black short
+ */
+static void __rb_erase_color(struct rb_node *parent, struct rb_root *root)
+{
+	struct rb_node *node = NULL, *sibling, *tmp1, *tmp2;
+
+	while (true) {
+		/**
+		 * Loop invariants:
+		 * - @node is black (or NULL on the first iteration)
+		 * - @node is not the root (@parent is not NULL)
+		 * - All leaf paths going through @parent and @node have a black
+		 *   node count that is 1 lower than other leaf paths
+		 */
+		sibling = parent->rb_right;
+		if (node != sibling) {	/* node == parent->rb_left */
+			if (rb_is_red(sibling)) {
+				/**
+				 * Case 1 - the sibling is red. Left rotate at the parent
+				 * to make the sibling black
+				 */
+				tmp1 = sibling->rb_left;
+				parent->rb_right = tmp1;
+				sibling->rb_left = parent;
+				rb_set_parent_color(tmp1, parent, RB_BLACK);
+				__rb_rotate_set_parents(parent, sibling, root, RB_RED);
+				sibling = tmp1;
+			}
+
+			tmp1 = sibling->rb_right;
+			if (!tmp1 || rb_is_black(tmp1)) {
+				tmp2 = sibling->rb_left;
+				if (!tmp2 || rb_is_black(tmp2)) {
+					/**
+					 * Case 2 - the sibling and its children are black.
+					 * Make the sibling red, and make the parent black if
+					 * it is red, or go on from the parent otherwise
+					 */
+					rb_set_parent_color(sibling, parent, RB_RED);
+					if (rb_is_red(parent)) {
+						rb_set_black(parent);
+					} else {
+						node = parent;
+						parent = rb_parent(node);
+						if (parent) continue;
+					}
+					break;
+				}
+
+				/**
+				 * Case 3 - the right child of the sibling is black and the
+				 * left one is red. Right rotate at the sibling to fall
+				 * into case 4
+				 */
+				tmp1 = tmp2->rb_right;
+				sibling->rb_left = tmp1;
+				tmp2->rb_right = sibling;
+				parent->rb_right = tmp2;
+				if (tmp1) rb_set_parent_color(tmp1, sibling, RB_BLACK);
+				tmp1 = sibling;
+				sibling = tmp2;
+			}
+
+			/**
+			 * Case 4 - the right child of the sibling is red. Left rotate
+			 * at the parent and flip the colors
+			 */
+			tmp2 = sibling->rb_left;
+			parent->rb_right = tmp2;
+			sibling->rb_left = parent;
+			rb_set_parent_color(tmp1, sibling, RB_BLACK);
+			if (tmp2) rb_set_parent(tmp2, parent);
+			__rb_rotate_set_parents(parent, sibling, root, RB_BLACK);
+			break;
+		} else {
+			/* Mirror of the above */
+			sibling = parent->rb_left;
+			if (rb_is_red(sibling)) {
+				tmp1 = sibling->rb_right;
+				parent->rb_left = tmp1;
+				sibling->rb_right = parent;
+				rb_set_parent_color(tmp1, parent, RB_BLACK);
+				__rb_rotate_set_parents(parent, sibling, root, RB_RED);
+				sibling = tmp1;
+			}
+
+			tmp1 = sibling->rb_left;
+			if (!tmp1 || rb_is_black(tmp1)) {
+				tmp2 = sibling->rb_right;
+				if (!tmp2 || rb_is_black(tmp2)) {
+					rb_set_parent_color(sibling, parent, RB_RED);
+					if (rb_is_red(parent)) {
+						rb_set_black(parent);
+					} else {
+						node = parent;
+						parent = rb_parent(node);
+						if (parent) continue;
+					}
+					break;
+				}
+
+				tmp1 = tmp2->rb_left;
+				sibling->rb_right = tmp1;
+				tmp2->rb_left = sibling;
+				parent->rb_left = tmp2;
+				if (tmp1) rb_set_parent_color(tmp1, sibling, RB_BLACK);
+				tmp1 = sibling;
+				sibling = tmp2;
+			}
+
+			tmp2 = sibling->rb_right;
+			parent->rb_left = tmp2;
+			sibling->rb_right = parent;
+			rb_set_parent_color(tmp1, sibling, RB_BLACK);
+			if (tmp2) rb_set_parent(tmp2, parent);
+			__rb_rotate_set_parents(parent, sibling, root, RB_BLACK);
+			break;
+		}
+	}
+}
+
+void rb_erase(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *child = node->rb_right;
+	struct rb_node *tmp = node->rb_left;
+	struct rb_node *parent, *rebalance;
+	unsigned long pc;
+
+	if (!tmp) {
+		/**
+		 * Case 1 - @node has no more than one child, which must be red
+		 * if any. Replace @node with the child
+		 */
+		pc = node->__rb_parent_color;
+		parent = __rb_parent(pc);
+		__rb_change_child(node, child, parent, root);
+		if (child) {
+			child->__rb_parent_color = pc;
+			rebalance = NULL;
+		} else {
+			rebalance = __rb_is_black(pc) ? parent : NULL;
+		}
+	} else if (!child) {
+		/* Still case 1, but the child is on the left */
+		tmp->__rb_parent_color = pc = node->__rb_parent_color;
+		parent = __rb_parent(pc);
+		__rb_change_child(node, tmp, parent, root);
+		rebalance = NULL;
+	} else {
+		struct rb_node *successor = child, *child2;
+
+		tmp = child->rb_left;
+		if (!tmp) {
+			/**
+			 * Case 2 - the successor of @node is its right child. Let
+			 * the successor take the place of @node
+			 */
+			parent = successor;
+			child2 = successor->rb_right;
+		} else {
+			/**
+			 * Case 3 - the successor is the leftmost one under the right
+			 * child. Take it out and let it take the place of @node
+			 */
+			do {
+				parent = successor;
+				successor = tmp;
+				tmp = tmp->rb_left;
+			} while (tmp);
+			child2 = successor->rb_right;
+			parent->rb_left = child2;
+			successor->rb_right = child;
+			rb_set_parent(child, successor);
+		}
+
+		tmp = node->rb_left;
+		successor->rb_left = tmp;
+		rb_set_parent(tmp, successor);
+
+		pc = node->__rb_parent_color;
+		tmp = __rb_parent(pc);
+		__rb_change_child(node, successor, tmp, root);
+
+		if (child2) {
+			successor->__rb_parent_color = pc;
+			rb_set_parent_color(child2, parent, RB_BLACK);
+			rebalance = NULL;
+		} else {
+			unsigned long pc2 = successor->__rb_parent_color;
+
+			successor->__rb_parent_color = pc;
+			rebalance = __rb_is_black(pc2) ? parent : NULL;
+		}
+	}
+
+	if (rebalance) __rb_erase_color(rebalance, root);
+}
+
+struct rb_node *rb_first(const struct rb_root *root)
+{
+	struct rb_node *n = root->rb_node;
+
+	if (!n) return NULL;
+	while (n->rb_left) n = n->rb_left;
+	return n;
+}
+
+struct rb_node *rb_last(const struct rb_root *root)
+{
+	struct rb_node *n = root->rb_node;
+
+	if (!n) return NULL;
+	while (n->rb_right) n = n->rb_right;
+	return n;
+}
+
+struct rb_node *rb_next(const struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (RB_EMPTY_NODE(node)) return NULL;
+
+	/* The leftmost one in the right subtree if there is */
+	if (node->rb_right) {
+		node = node->rb_right;
+		while (node->rb_left) node = node->rb_left;
+		return (struct rb_node *)node;
+	}
+
+	/* Or the first ancestor that @node is on the left of */
+	while ((parent = rb_parent(node)) && node == parent->rb_right) {
+		node = parent;
+	}
+	return parent;
+}
+
+struct rb_node *rb_prev(const struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (RB_EMPTY_NODE(node)) return NULL;
+
+	if (node->rb_left) {
+		node = node->rb_left;
+		while (node->rb_right) node = node->rb_right;
+		return (struct rb_node *)node;
+	}
+
+	while ((parent = rb_parent(node)) && node == parent->rb_left) {
+		node = parent;
+	}
+	return parent;
+}
@@ -0,0 +1,157 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __RBTREE_H__
+#define __RBTREE_H__
+
+#include "types.h"
+#include "list_head.h"
+
+/**
+ * Intrusive red-black tree in the style of the Linux kernel. Embed struct
+ * rb_node into the structure to put into the tree, and get the structure
+ * back with rb_entry(). The tree does not compare the nodes by itself; the
+ * user walks down to the place to insert at, links the node there with
+ * rb_link_node(), and then rebalances the tree with rb_insert_color(). Or
+ * use rb_add_cached() with a less() function to do all three.
+ *
+ * The color of a node is kept in the lowest bit of its parent pointer, so
+ * a node takes three words.
+ */
+struct rb_node {
+	unsigned long __rb_parent_color;
+	struct rb_node *rb_right;
+	struct rb_node *rb_left;
+} __attribute__((aligned(sizeof(long))));
+
+struct rb_root {
+	struct rb_node *rb_node;
+};
+
+/**
+ * The tree with its leftmost node cached, so that the smallest one is found
+ * in O(1)
+ */
+struct rb_root_cached {
+	struct rb_root rb_root;
+	struct rb_node *rb_leftmost;
+};
+
+#define RB_ROOT			(struct rb_root) { NULL, }
+#define RB_ROOT_CACHED	(struct rb_root_cached) { { NULL, }, NULL }
+
+#define rb_parent(r)	((struct rb_node *)((r)->__rb_parent_color & ~3))
+
+#define rb_entry(ptr, type, member)	container_of(ptr, type, member)
+
+#define RB_EMPTY_ROOT(root)	((root)->rb_node == NULL)
+
+/* A node is empty if it is not in any tree, and marked so with RB_CLEAR_NODE */
+#define RB_EMPTY_NODE(node)	\
+	((node)->__rb_parent_color == (unsigned long)(node))
+#define RB_CLEAR_NODE(node)	\
+	((node)->__rb_parent_color = (unsigned long)(node))
+
+/***********************************************************************
+ * rb_insert_color()
+ *
+ * DESCRIPTION
+ *   Rebalance @root after @node is linked into it with rb_link_node().
+ */
+void rb_insert_color(struct rb_node *node, struct rb_root *root);
+
+/***********************************************************************
+ * rb_erase()
+ *
+ * DESCRIPTION
+ *   Take @node out of @root and rebalance it. @node is left as it is; use
+ *   RB_CLEAR_NODE() to mark it out of the tree.
+ */
+void rb_erase(struct rb_node *node, struct rb_root *root);
+
+/**
+ * rb_first/rb_last - the smallest/largest node in @root, or NULL if empty
+ * rb_next/rb_prev - the node following/preceding @node in the order, or NULL
+ */
+struct rb_node *rb_first(const struct rb_root *root);
+struct rb_node *rb_last(const struct rb_root *root);
+struct rb_node *rb_next(const struct rb_node *node);
+struct rb_node *rb_prev(const struct rb_node *node);
+
+/**
+ * rb_link_node - put @node at @rb_link, the empty child pointer of @parent
+ *                found by walking down the tree
+ */
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent,
+		struct rb_node **rb_link)
+{
+	node->__rb_parent_color = (unsigned long)parent;
+	node->rb_left = node->rb_right = NULL;
+
+	*rb_link = node;
+}
+
+#define rb_first_cached(root)	((root)->rb_leftmost)
+
+/**
+ * rb_insert_color_cached - rb_insert_color() for the cached tree. @leftmost
+ *                          is true if @node was linked as the leftmost one
+ */
+static inline void rb_insert_color_cached(struct rb_node *node,
+		struct rb_root_cached *root, bool leftmost)
+{
+	if (leftmost) root->rb_leftmost = node;
+	rb_insert_color(node, &root->rb_root);
+}
+
+static inline void rb_erase_cached(struct rb_node *node,
+		struct rb_root_cached *root)
+{
+	if (root->rb_leftmost == node) root->rb_leftmost = rb_next(node);
+	rb_erase(node, &root->rb_root);
+}
+
+/**
+ * rb_add_cached - insert @node into @tree in the order of @less. A node
+ *                 goes after the ones that are not greater, so the ties are
+ *                 kept in the order of insertion
+ *
+ * RETURN
+ *   true if @node is the leftmost one now
+ */
+static inline bool rb_add_cached(struct rb_node *node, struct rb_root_cached *tree,
+		bool (*less)(struct rb_node *, const struct rb_node *))
+{
+	struct rb_node **link = &tree->rb_root.rb_node;
+	struct rb_node *parent = NULL;
+	bool leftmost = true;
+
+	while (*link) {
+		parent = *link;
+		if (less(node, parent)) {
+			link = &parent->rb_left;
+		} else {
+			link = &parent->rb_right;
+			leftmost = false;
+		}
+	}
+
+	rb_link_node(node, parent, link);
+	rb_insert_color_cached(node, tree, leftmost);
+
+	return leftmost;
+}
+
+#endif
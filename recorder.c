@@ -0,0 +1,220 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "types.h"
+#include "list_head.h"
+#include "process.h"
+#include "recorder.h"
+
+/* # of arguments following each item */
+static const unsigned int __nr_args[NR_RECORD_ITEMS] = {
+	[RECORD_CPU] = 1,
+	[RECORD_CURRENT] = 0,
+	[RECORD_READY] = 0,
+	[RECORD_PROCESS] = 6,
+	[RECORD_RESOURCES] = 0,
+	[RECORD_OWNER] = 2,
+	[RECORD_WAITER] = 1,
+};
+
+struct recorder *recorder_create(unsigned int nr_slots)
+{
+	struct recorder *rec;
+
+	if (!nr_slots) return NULL;
+
+	rec = calloc(1, sizeof(*rec));
+	if (!rec) return NULL;
+
+	rec->slots = calloc(nr_slots, sizeof(*rec->slots));
+	if (!rec->slots) {
+		free(rec);
+		return NULL;
+	}
+	rec->nr_slots = nr_slots;
+
+	return rec;
+}
+
+void recorder_begin(struct recorder *rec, unsigned int tick, unsigned int nr_cpus)
+{
+	struct recorder_status *status = rec->slots + rec->nr_statuses % rec->nr_slots;
+
+	status->tick = tick;
+	status->nr_cpus = nr_cpus;
+	status->len = 0;
+
+	rec->recording = status;
+	rec->failed = false;
+}
+
+/**
+ * Put @item with its arguments @args into the status being recorded. The
+ * words grow as needed, and are reused by the statuses on the slot after
+ */
+static void __put(struct recorder *rec, enum recorder_item item, const int *args)
+{
+	struct recorder_status *status = rec->recording;
+	size_t len;
+
+	assert(status);
+	if (rec->failed) return;
+
+	len = 1 + __nr_args[item];
+	if (status->len + len > status->size) {
+		size_t size = status->size ? status->size * 2 : 64;
+		int *words;
+
+		while (size < status->len + len) size *= 2;
+
+		words = realloc(status->words, sizeof(*words) * size);
+		if (!words) {
+			rec->failed = true;
+			return;
+		}
+		status->words = words;
+		status->size = size;
+	}
+
+	status->words[status->len] = item;
+	memcpy(status->words + status->len + 1, args, sizeof(*args) * __nr_args[item]);
+	status->len += len;
+}
+
+void recorder_item(struct recorder *rec, enum recorder_item item, int arg)
+{
+	assert(item != RECORD_PROCESS && item != RECORD_OWNER);
+
+	__put(rec, item, &arg);
+}
+
+void recorder_owner(struct recorder *rec, int resource_id, int pid)
+{
+	int args[] = { resource_id, pid };
+
+	__put(rec, RECORD_OWNER, args);
+}
+
+void recorder_process(struct recorder *rec, const struct process *p)
+{
+	int args[] = {
+		p->pid, p->status, p->__starts_at, p->age, p->lifespan, p->prio,
+	};
+
+	__put(rec, RECORD_PROCESS, args);
+}
+
+void recorder_commit(struct recorder *rec)
+{
+	assert(rec->recording);
+
+	if (rec->failed) {
+		rec->nr_lost++;
+	} else {
+		rec->nr_statuses++;
+	}
+	rec->recording = NULL;
+}
+
+static void __print_status(const struct recorder_status *status)
+{
+	const int *w = status->words;
+	const int *end = status->words + status->len;
+
+	printf("***** TICK %-5u ******\n", status->tick);
+
+	for (; w < end; w += 1 + __nr_args[*w]) {
+		switch (*w) {
+		case RECORD_CPU:
+			if (status->nr_cpus > 1) {
+				printf("***** CPU %-3u *********\n", w[1]);
+			}
+			break;
+		case RECORD_CURRENT:
+			printf("***** CURRENT *********\n");
+			break;
+		case RECORD_READY:
+			printf("***** READY QUEUE *****\n");
+			break;
+		case RECORD_PROCESS: {
+			struct process p = {
+				.pid = w[1],
+				.status = w[2],
+				.__starts_at = w[3],
+				.age = w[4],
+				.lifespan = w[5],
+				.prio = w[6],
+			};
+
+			dump_process(&p);
+			break;
+		}
+		case RECORD_RESOURCES:
+			printf("***** RESOURCES *******\n");
+			break;
+		case RECORD_OWNER:
+			printf("%2d: owned by ", w[1]);
+			if (w[2] >= 0) {
+				printf("%d\n", w[2]);
+			} else {
+				printf("no one\n");
+			}
+			break;
+		case RECORD_WAITER:
+			printf("    %d is waiting\n", w[1]);
+			break;
+		}
+	}
+	printf("\n\n");
+}
+
+void recorder_print(struct recorder *rec)
+{
+	unsigned long long from = rec->nr_printed;
+
+	/* dump_process() prints rather than records from now on */
+	rec->recording = NULL;
+
+	if (from == rec->nr_statuses) return;
+	if (rec->nr_statuses - from > rec->nr_slots) {
+		from = rec->nr_statuses - rec->nr_slots;
+	}
+
+	printf("***** FLIGHT RECORDER: last %llu of %llu statuses",
+			rec->nr_statuses - from, rec->nr_statuses);
+	if (rec->nr_lost) printf(", %llu lost for memory", rec->nr_lost);
+	printf("\n\n");
+
+	for (unsigned long long n = from; n < rec->nr_statuses; n++) {
+		__print_status(rec->slots + n % rec->nr_slots);
+	}
+	fflush(stdout);
+
+	rec->nr_printed = rec->nr_statuses;
+}
+
+void recorder_destroy(struct recorder *rec)
+{
+	for (unsigned int i = 0; i < rec->nr_slots; i++) {
+		free(rec->slots[i].words);
+	}
+	free(rec->slots);
+	free(rec);
+}
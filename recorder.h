@@ -0,0 +1,144 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <stddef.h>
+
+#include "types.h"
+
+struct process;
+
+/**
+ * Flight recorder of the status of a simulation. Rather than printing the
+ * status on every dump_status() call, the simulation records it into a ring
+ * of the latest statuses in a compact binary form, and the recorder prints
+ * them in the format of dump_status() only when the simulation is over,
+ * aborts, or is signalled to quit.
+ *
+ * A status is a sequence of the items below in int words, each of which is
+ * the item followed by its arguments.
+ */
+enum recorder_item {
+	RECORD_CPU,			/* id. The status of processor id follows */
+	RECORD_CURRENT,		/* The current process follows, if any */
+	RECORD_READY,		/* The processes ready to run follow */
+	RECORD_PROCESS,		/* pid, status, starts_at, age, lifespan, prio */
+	RECORD_RESOURCES,	/* The active resources follow */
+	RECORD_OWNER,		/* resource id, pid of the owner or -1 */
+	RECORD_WAITER,		/* pid of a process waiting for the resource above */
+	NR_RECORD_ITEMS,
+};
+
+struct recorder_status {
+	unsigned int tick;
+	unsigned int nr_cpus;
+	int *words;
+	size_t len;			/* # of words in @words */
+	size_t size;		/* and the capacity of @words */
+};
+
+struct recorder {
+	unsigned int nr_slots;
+	struct recorder_status *slots;
+								/* The status n is in @slots[n % @nr_slots] */
+	unsigned long long nr_statuses;
+								/* # of statuses recorded so far */
+	unsigned long long nr_printed;
+								/* @nr_statuses when printed last */
+	unsigned long long nr_lost;	/* # of statuses dropped for memory */
+
+	struct recorder_status *recording;
+								/* The status being recorded, or NULL */
+	bool failed;				/* to grow @recording */
+};
+
+/***********************************************************************
+ * recorder_create()
+ *
+ * DESCRIPTION
+ *   Create a flight recorder keeping the latest @nr_slots statuses.
+ *
+ * RETURN
+ *   The recorder, or NULL on error
+ */
+struct recorder *recorder_create(unsigned int nr_slots);
+
+/***********************************************************************
+ * recorder_begin()
+ *
+ * DESCRIPTION
+ *   Start recording the status of @nr_cpus processors at @tick over the
+ *   oldest one. Record the items with recorder_item(), recorder_owner() and
+ *   recorder_process(), and then call recorder_commit().
+ */
+void recorder_begin(struct recorder *rec, unsigned int tick, unsigned int nr_cpus);
+
+/***********************************************************************
+ * recorder_item()
+ *
+ * DESCRIPTION
+ *   Record @item with no argument, or with @arg for RECORD_CPU and
+ *   RECORD_WAITER.
+ */
+void recorder_item(struct recorder *rec, enum recorder_item item, int arg);
+
+/***********************************************************************
+ * recorder_owner()
+ *
+ * DESCRIPTION
+ *   Record that resource @resource_id is owned by @pid, or by no one if @pid
+ *   is -1.
+ */
+void recorder_owner(struct recorder *rec, int resource_id, int pid);
+
+/***********************************************************************
+ * recorder_process()
+ *
+ * DESCRIPTION
+ *   Record process @p as dump_process() would print it.
+ */
+void recorder_process(struct recorder *rec, const struct process *p);
+
+/***********************************************************************
+ * recorder_commit()
+ *
+ * DESCRIPTION
+ *   Finish recording the status started with recorder_begin(). It is
+ *   dropped if the recorder ran out of memory while recording it.
+ */
+void recorder_commit(struct recorder *rec);
+
+/***********************************************************************
+ * recorder_print()
+ *
+ * DESCRIPTION
+ *   Print the statuses recorded since it was called last, up to the latest
+ *   @rec->nr_slots of them, in the format of dump_status() prefixed by
+ *   their ticks. Nothing is printed if no status is recorded since. The
+ *   status being recorded, if any, is abandoned.
+ */
+void recorder_print(struct recorder *rec);
+
+/***********************************************************************
+ * recorder_destroy()
+ *
+ * DESCRIPTION
+ *   Release @rec without printing it.
+ */
+void recorder_destroy(struct recorder *rec);
+
+#endif
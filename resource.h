@@ -18,6 +18,7 @@
 
 struct process;
 struct list_head;
+struct prio_waitqueue;
 
 /**
  * Resources in the system.
@@ -33,12 +34,21 @@ struct resource {
 	 * list head to list processes that are wanting for the resource
 	 */
 	struct list_head waitqueue;
+
+	/**
+	 * Waiters in the priority order, for the schedulers that give out the
+	 * resource to the highest-priority waiter. NULL until the scheduler
+	 * asks for it with sim_prio_waitqueue(). See prio_waitqueue.h
+	 */
+	struct prio_waitqueue *prio_waitqueue;
 };
 
 /**
- * This system has 32 different resources. It is defined in pa2.c as an array of
- * struct resource (i.e., struct resource resources[NR_RESOURCES];)
+ * The system has as many resources as the process script refers to; resource
+ * ids span 0 .. the largest id in the script. The table is allocated while
+ * loading the script, and may grow as processes are streamed in. Thus do not
+ * keep pointers to the resources across the scheduler callbacks.
  */
-#define NR_RESOURCES 32
+#define MAX_RESOURCES	(1 << 24)	/* Resource ids should be less than this */
 
 #endif
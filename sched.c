@@ -19,52 +19,36 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 #include <unistd.h>
-#include <getopt.h>
+#include <signal.h>
 
 #include "types.h"
 #include "list_head.h"
+#include "bitmap.h"
 
-#include "parser.h"
 #include "process.h"
 #include "resource.h"
+#include "prio_waitqueue.h"
 
 #include "sched.h"
+#include "sim.h"
 
 /**
- * List head to hold the processes ready to run
+ * The scheduler to call back. The specialized builds (sched-<tag> in the
+ * Makefile) are compiled with SIM_SCHEDULER set to one of the schedulers in
+ * pa2.c, so its callbacks are called directly and the hooks it leaves NULL
+ * are compiled out. The generic build calls through @sim->sched.
  */
-LIST_HEAD(readyqueue);
+#ifdef SIM_SCHEDULER
+#define __sched(sim)	(&SIM_SCHEDULER)
+#else
+#define __sched(sim)	((sim)->sched)
+#endif
 
-/**
- * The process that is currently running
- */
-struct process *current = NULL;
-
-/**
- * Number of generated ticks since the simulator was started
- */
-unsigned int ticks = 0;
-
-/**
- * Resources in the system.
- */
-struct resource resources[NR_RESOURCES];
-
-/**
- * Following code is to maintain the simulator itself.
- */
-struct resource_schedule {
-	int resource_id;
-	int at;
-	int duration;
-	struct list_head list;
-};
-
-static LIST_HEAD(__forkqueue);
-
-bool quiet = false;
+__thread struct sim_context *this_sim = NULL;
+__thread struct sim_cpu *this_cpu = NULL;
 
 static const char * __process_status_sz[] = {
 	"RDY",
@@ -73,50 +57,127 @@ static const char * __process_status_sz[] = {
 	"EXT",
 };
 
+void dump_process(struct process *p)
+{
+	/* The scheduler dumps its run queue while the status is recorded */
+	if (this_sim && this_sim->__recorder && this_sim->__recorder->recording) {
+		recorder_process(this_sim->__recorder, p);
+		return;
+	}
+
+	printf("%2d (%s): %d + %d/%d at %d\n",
+			p->pid, __process_status_sz[p->status],
+			p->__starts_at, p->age, p->lifespan, p->prio);
+}
+
 /**
- * Assorted schedulers
+ * Record the status into the flight recorder as dump_status() prints it
  */
-extern struct scheduler fifo_scheduler;
-extern struct scheduler sjf_scheduler;
-extern struct scheduler srtf_scheduler;
-extern struct scheduler rr_scheduler;
-extern struct scheduler prio_scheduler;
-extern struct scheduler pcp_scheduler;
-extern struct scheduler pip_scheduler;
+static void __record_status(struct sim_context *sim)
+{
+	struct recorder *rec = sim->__recorder;
+	struct sim_cpu *cpu = this_cpu;
+	struct process *p;
+	unsigned int i;
+
+	recorder_begin(rec, sim->ticks, sim->nr_cpus);
+
+	for (i = 0; i < sim->nr_cpus; i++) {
+		struct sim_cpu *c = sim->cpus + i;
 
-static struct scheduler *sched = &fifo_scheduler;
+		recorder_item(rec, RECORD_CPU, c->id);
+
+		recorder_item(rec, RECORD_CURRENT, 0);
+		if (c->current) {
+			recorder_process(rec, c->current);
+		}
+
+		recorder_item(rec, RECORD_READY, 0);
+		list_for_each_entry(p, &c->readyqueue, list) {
+			recorder_process(rec, p);
+		}
+		this_cpu = c;
+		if (__sched(sim)->dump) __sched(sim)->dump();
+	}
+	this_cpu = cpu;
+
+	recorder_item(rec, RECORD_RESOURCES, 0);
+	bitmap_for_each_set(i, sim->__active_resources, sim->nr_resources) {
+		struct resource *r = sim->resources + i;
+
+		recorder_owner(rec, i, r->owner ? (int)r->owner->pid : -1);
+
+		list_for_each_entry(p, &r->waitqueue, list) {
+			recorder_item(rec, RECORD_WAITER, p->pid);
+		}
+		if (r->prio_waitqueue) {
+			int prio;
+
+			prio_waitqueue_for_each_entry(p, r->prio_waitqueue, prio) {
+				recorder_item(rec, RECORD_WAITER, p->pid);
+			}
+		}
+	}
+
+	recorder_commit(rec);
+}
 
 void dump_status(void)
 {
+	struct sim_context *sim = this_sim;
+	struct sim_cpu *cpu = this_cpu;
 	struct process *p;
+	unsigned int i;
+
+	if (sim->options.silent_status) return;
 
-	printf("***** CURRENT *********\n");
-	if (current) {
-		printf("%2d (%s): %d + %d/%d at %d\n",
-				current->pid, __process_status_sz[current->status],
-				current->__starts_at,
-				current->age, current->lifespan, current->prio);
+	if (sim->__recorder) {
+		__record_status(sim);
+		return;
 	}
 
-	printf("***** READY QUEUE *****\n");
-	list_for_each_entry(p, &readyqueue, list) {
-		printf("%2d (%s): %d + %d/%d at %d\n",
-				p->pid, __process_status_sz[p->status],
-				p->__starts_at, p->age, p->lifespan, p->prio);
+	/* Keep the trace and the status in order on the console */
+	trace_flush(&sim->__trace);
+
+	for (i = 0; i < sim->nr_cpus; i++) {
+		struct sim_cpu *c = sim->cpus + i;
+
+		if (sim->nr_cpus > 1) {
+			printf("***** CPU %-3u *********\n", c->id);
+		}
+
+		printf("***** CURRENT *********\n");
+		if (c->current) {
+			dump_process(c->current);
+		}
+
+		printf("***** READY QUEUE *****\n");
+		list_for_each_entry(p, &c->readyqueue, list) {
+			dump_process(p);
+		}
+		this_cpu = c;
+		if (__sched(sim)->dump) __sched(sim)->dump();
 	}
+	this_cpu = cpu;
 
 	printf("***** RESOURCES *******\n");
-	for (int i = 0; i < NR_RESOURCES; i++) {
-		struct resource *r = resources + i;;
-		if (r->owner || !list_empty(&r->waitqueue)) {
-			printf("%2d: owned by ", i);
-			if (r->owner) {
-				printf("%d\n", r->owner->pid);
-			} else {
-				printf("no one\n");
-			}
+	bitmap_for_each_set(i, sim->__active_resources, sim->nr_resources) {
+		struct resource *r = sim->resources + i;
+
+		printf("%2d: owned by ", i);
+		if (r->owner) {
+			printf("%d\n", r->owner->pid);
+		} else {
+			printf("no one\n");
+		}
 
-			list_for_each_entry(p, &r->waitqueue, list) {
+		list_for_each_entry(p, &r->waitqueue, list) {
+			printf("    %d is waiting\n", p->pid);
+		}
+		if (r->prio_waitqueue) {
+			int prio;
+
+			prio_waitqueue_for_each_entry(p, r->prio_waitqueue, prio) {
 				printf("    %d is waiting\n", p->pid);
 			}
 		}
@@ -126,120 +187,293 @@ void dump_status(void)
 	return;
 }
 
-#define __print_event(pid, string, args...) do { \
-	fprintf(stderr, "%3d: ", ticks); \
-	for (int i = 0; i < pid; i++) { \
-		fprintf(stderr, "    "); \
-	} \
-	fprintf(stderr, string "\n", ##args); \
-} while (0);
-
-static inline bool strmatch(char * const str, const char *expect)
+/**
+ * Trace event @type of @p on @cpu, and log it if the events are logged. @p
+ * is NULL for TRACE_IDLE
+ */
+static inline void __trace_event(struct sim_context *sim, struct sim_cpu *cpu,
+		struct process *p, enum trace_type type, int arg)
 {
-	return (strlen(str) == strlen(expect)) && (strncmp(str, expect, strlen(expect)) == 0);
+	trace_event(&sim->__trace, sim->ticks, cpu->id, p ? p->pid : 0, type, arg);
+
+	if (sim->__eventlog) {
+		if (type == TRACE_RUN || type == TRACE_IDLE) arg = 1;
+		eventlog_event(sim->__eventlog, sim->ticks, cpu->id, p ? p->pid : 0,
+				type, arg, p ? p->prio : 0);
+	}
 }
 
-static void __briefing_process(struct process *p)
+#define __print_event(cpu, p, type, arg) \
+	__trace_event(sim, cpu, p, type, arg)
+
+
+/**
+ * Grow the resource table to have @nr_resources resources at least. The
+ * table is moved to the larger one, taking the waitqueues along
+ */
+bool __sim_reserve_resources(struct sim_context *sim, unsigned int nr_resources)
 {
-	struct resource_schedule *rs;
+	struct resource *resources;
+	unsigned long long *active;
+	unsigned int max = sim->__max_resources ? sim->__max_resources : 32;
 
-	if (quiet) return;
+	if (nr_resources <= sim->nr_resources) return true;
 
-	printf("- Process %d: Forked at tick %d and run for %d tick%s with initial priority %d\n",
-				p->pid, p->__starts_at, p->lifespan,
-				p->lifespan >= 2 ? "s" : "", p->prio);
+	if (sim->__metrics &&
+			!metrics_reserve_resources(sim->__metrics, nr_resources)) {
+		return false;
+	}
+
+	if (nr_resources > sim->__max_resources) {
+		while (max < nr_resources) max *= 2;
+
+		resources = malloc(sizeof(*resources) * max);
+		if (!resources) return false;
 
-	list_for_each_entry(rs, &p->__resources_to_acquire, list) {
-		printf("    Acquire resource %d at %d for %d\n", rs->resource_id, rs->at, rs->duration);
+		active = calloc(BITMAP_WORDS(max), sizeof(*active));
+		if (!active) {
+			free(resources);
+			return false;
+		}
+
+		for (unsigned int i = 0; i < sim->nr_resources; i++) {
+			struct resource *r = sim->resources + i;
+
+			resources[i].owner = r->owner;
+			resources[i].prio_waitqueue = r->prio_waitqueue;
+			if (list_empty(&r->waitqueue)) {
+				INIT_LIST_HEAD(&resources[i].waitqueue);
+			} else {
+				list_replace(&r->waitqueue, &resources[i].waitqueue);
+			}
+		}
+		if (sim->nr_resources) {
+			memcpy(active, sim->__active_resources,
+					sizeof(*active) * BITMAP_WORDS(sim->nr_resources));
+		}
+
+		free(sim->resources);
+		free(sim->__active_resources);
+		sim->resources = resources;
+		sim->__active_resources = active;
+		sim->__max_resources = max;
+	}
+
+	for (unsigned int i = sim->nr_resources; i < nr_resources; i++) {
+		sim->resources[i].owner = NULL;
+		INIT_LIST_HEAD(&sim->resources[i].waitqueue);
+		sim->resources[i].prio_waitqueue = NULL;
 	}
+	sim->nr_resources = nr_resources;
+
+	return true;
 }
 
-static int __load_script(char * const filename)
+/**
+ * Mark resource @resource_id active if it is owned or has waiters
+ */
+void __sim_update_resource(struct sim_context *sim, int resource_id)
 {
-	char line[256];
-	struct process *p = NULL;
+	struct resource *r = sim->resources + resource_id;
 
-	FILE *file = fopen(filename, "r");
-	while (fgets(line, sizeof(line), file)) {
-		char *tokens[32] = { NULL };
-		int nr_tokens;
+	if (r->owner || !list_empty(&r->waitqueue) ||
+			(r->prio_waitqueue && !prio_waitqueue_empty(r->prio_waitqueue))) {
+		bitmap_set(sim->__active_resources, resource_id);
+	} else {
+		bitmap_clear(sim->__active_resources, resource_id);
+	}
+}
 
-		parse_command(line, &nr_tokens, tokens);
+void sim_log_prio(struct process *p, unsigned int prio)
+{
+	struct sim_context *sim = this_sim;
 
-		if (nr_tokens == 0) continue;
+	if (!sim->__eventlog || p->prio == prio) return;
 
-		if (strmatch(tokens[0], "process")) {
-			assert(nr_tokens == 2);
-			/* Start processor description */
-			p = malloc(sizeof(*p));
-			memset(p, 0x00, sizeof(*p));
+	eventlog_event(sim->__eventlog, sim->ticks, p->cpu, p->pid, EVENTLOG_PRIO,
+			prio, p->prio);
+}
 
-			p->pid = atoi(tokens[1]);
+struct prio_waitqueue *sim_prio_waitqueue(int resource_id)
+{
+	struct sim_context *sim = this_sim;
+	struct resource *r = sim->resources + resource_id;
 
-			INIT_LIST_HEAD(&p->list);
-			INIT_LIST_HEAD(&p->__resources_to_acquire);
-			INIT_LIST_HEAD(&p->__resources_holding);
+	assert(resource_id >= 0 && resource_id < sim->nr_resources);
 
-			continue;
-		} else if (strmatch(tokens[0], "end")) {
-			/* End of process description */
-			struct resource_schedule *rs;
-			assert(p);
+	if (!r->prio_waitqueue) {
+		r->prio_waitqueue = pool_alloc(&sim->__waitqueue_pool);
+		if (!r->prio_waitqueue) {
+			trace_flush(&sim->__trace);
+			fprintf(stderr, "Out of memory while waiting for resource\n");
+			exit(EXIT_FAILURE);
+		}
+		prio_waitqueue_init(r->prio_waitqueue);
+	}
+	return r->prio_waitqueue;
+}
 
-			list_add_tail(&p->list, &__forkqueue);
+struct process_donations *sim_process_donations(struct process *p)
+{
+	struct sim_context *sim = this_sim;
+
+	if (!p->donations) {
+		p->donations = pool_alloc(&sim->__donation_pool);
+		if (!p->donations) {
+			trace_flush(&sim->__trace);
+			fprintf(stderr, "Out of memory while donating priority\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(p->donations, 0x00, sizeof(*p->donations));
+	}
+	return p->donations;
+}
+
+/**
+ * Insert @resource_id into the held resources of @p, keeping them sorted.
+ * The array is not shrunk, so it has room for at least four, or for the
+ * power of two not less than @p->nr_held_resources. Grow it when it gets
+ * full by that measure
+ */
+void __sim_hold_resource(struct sim_context *sim, struct process *p,
+		int resource_id)
+{
+	unsigned int i = p->nr_held_resources;
 
-			__briefing_process(p);
-			p = NULL;
+	if (!p->held_resources || (i >= 4 && !(i & (i - 1)))) {
+		unsigned int max = i ? i * 2 : 4;
+		int *held = realloc(p->held_resources, sizeof(*held) * max);
 
-			continue;
+		if (!held) {
+			trace_flush(&sim->__trace);
+			fprintf(stderr, "Out of memory while acquiring resource\n");
+			exit(EXIT_FAILURE);
 		}
+		p->held_resources = held;
+	}
 
-		if (strmatch(tokens[0], "lifespan")) {
-			assert(nr_tokens == 2);
-			p->lifespan = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "prio")) {
-			assert(nr_tokens == 2);
-			p->prio = p->prio_orig = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "start")) {
-			assert(nr_tokens == 2);
-			p->__starts_at = atoi(tokens[1]);
-		} else if (strmatch(tokens[0], "acquire")) {
-			struct resource_schedule *rs;
-			assert(nr_tokens == 4);
+	while (i > 0 && p->held_resources[i - 1] > resource_id) {
+		p->held_resources[i] = p->held_resources[i - 1];
+		i--;
+	}
+	p->held_resources[i] = resource_id;
+	p->nr_held_resources++;
+}
 
-			rs = malloc(sizeof(*rs));
+static void __unhold_resource(struct process *p, int resource_id)
+{
+	unsigned int i = 0;
 
-			rs->resource_id = atoi(tokens[1]);
-			rs->at = atoi(tokens[2]);
-			rs->duration = atoi(tokens[3]);
+	while (i < p->nr_held_resources && p->held_resources[i] != resource_id) i++;
+	assert(i < p->nr_held_resources);
 
-			list_add_tail(&rs->list, &p->__resources_to_acquire);
-		} else {
-			fprintf(stderr, "Unknown property %s\n", tokens[0]);
-			return false;
+	p->nr_held_resources--;
+	memmove(p->held_resources + i, p->held_resources + i + 1,
+			sizeof(*p->held_resources) * (p->nr_held_resources - i));
+}
+
+
+/**
+ * The processor with the fewest processes to run. @prefer wins the tie, and
+ * then the one with the smaller id
+ */
+static struct sim_cpu *__least_loaded_cpu(struct sim_context *sim,
+		struct sim_cpu *prefer)
+{
+	struct sim_cpu *cpu = prefer;
+
+	for (unsigned int i = 0; i < sim->nr_cpus; i++) {
+		if (sim->cpus[i].nr_running < cpu->nr_running) {
+			cpu = sim->cpus + i;
 		}
 	}
-	fclose(file);
-	if (!quiet) printf("\n");
-	return true;
+	return cpu;
+}
+
+struct sim_cpu *sim_place_process(struct process *p, bool wakeup)
+{
+	struct sim_context *sim = this_sim;
+	struct sim_cpu *cpu;
+
+	if (__sched(sim)->select_cpu) {
+		int id = __sched(sim)->select_cpu(p, wakeup);
+
+		assert(id >= 0 && id < sim->nr_cpus && "scheduler.select_cpu() returned an invalid processor");
+		cpu = sim->cpus + id;
+	} else {
+		cpu = __least_loaded_cpu(sim, sim->cpus + p->cpu);
+	}
+
+	p->cpu = cpu->id;
+	cpu->nr_running++;
+
+	/* Woken up in this tick, and ready from the next */
+	if (wakeup && sim->__metrics) {
+		struct process_metrics *pm = p->__metrics;
+		unsigned int blocked = sim->ticks + 1 - pm->blocked_since;
+
+		pm->blocked_ticks += blocked;
+		sim->__metrics->blocked_by_resource[pm->blocked_on] += blocked;
+		pm->ready_since = sim->ticks + 1;
+	}
+
+	return cpu;
 }
 
 
 /**
  * Fork process on schedule
  */
-static int __fork_on_schedule()
+static void __feed_forkqueue(struct sim_context *sim)
+{
+	/**
+	 * Keep all processes due by now in @__forkqueue, and one more to tell
+	 * when the next fork happens
+	 */
+	while (sim->__pull_process &&
+			(list_empty(&sim->__forkqueue) ||
+			 list_last_entry(&sim->__forkqueue, struct process, list)->__starts_at <= sim->ticks)) {
+		struct process *p = sim->__pull_process(sim);
+
+		if (!p) {
+			sim->__pull_process = NULL;
+			break;
+		}
+		list_add_tail(&p->list, &sim->__forkqueue);
+		sim->__nr_forkqueue++;
+	}
+}
+
+static int __fork_on_schedule(struct sim_context *sim)
 {
 	int nr_forked = 0;
-	struct process *p, *tmp;
-	list_for_each_entry_safe(p, tmp, &__forkqueue, list) {
-		if (p->__starts_at <= ticks) {
-			list_move_tail(&p->list, &readyqueue);
-			p->status = PROCESS_READY;
-			__print_event(p->pid, "N");
-			if (sched->forked) sched->forked(p);
-			nr_forked++;
+
+	__feed_forkqueue(sim);
+
+	/* @__forkqueue is sorted, so only look at the processes due now */
+	while (!list_empty(&sim->__forkqueue)) {
+		struct process *p =
+				list_first_entry(&sim->__forkqueue, struct process, list);
+		struct sim_cpu *cpu;
+
+		if (p->__starts_at > sim->ticks) break;
+
+		cpu = sim_place_process(p, false);
+
+		list_move_tail(&p->list, &cpu->readyqueue);
+		sim->__nr_forkqueue--;
+		sim->stats.nr_forked++;
+		p->status = PROCESS_READY;
+		if (sim->__metrics && !metrics_fork_process(sim->__metrics, p, sim->ticks)) {
+			trace_flush(&sim->__trace);
+			fprintf(stderr, "Out of memory while forking process\n");
+			exit(EXIT_FAILURE);
 		}
+		__print_event(cpu, p, TRACE_FORK, 0);
+
+		this_cpu = cpu;
+		if (__sched(sim)->forked) __sched(sim)->forked(p);
+		nr_forked++;
 	}
 	return nr_forked;
 }
@@ -247,7 +481,8 @@ static int __fork_on_schedule()
 /**
  * Exit the process
  */
-static void __exit_process(struct process *p)
+static void __exit_process(struct sim_context *sim, struct sim_cpu *cpu,
+		struct process *p)
 {
 	/* Make sure the process is not attached to some list head */
 	assert(list_empty(&p->list));
@@ -258,33 +493,70 @@ static void __exit_process(struct process *p)
 	/* Make sure there is no pending resource to acquire */
 	assert(list_empty(&p->__resources_to_acquire));
 
-	if (sched->exiting) sched->exiting(p);
+	assert(p->nr_held_resources == 0);
+	free(p->held_resources);
+	if (p->donations) pool_free(&sim->__donation_pool, p->donations);
 
-	__print_event(p->pid, "X");
+	if (__sched(sim)->exiting) __sched(sim)->exiting(p);
 
-	free(p);
+	__print_event(cpu, p, TRACE_EXIT, 0);
+
+	cpu->nr_running--;
+
+	if (sim->__metrics) metrics_exit_process(sim->__metrics, p, sim->ticks);
+
+	sim->stats.nr_exited++;
+	sim->stats.turnaround += sim->ticks - p->__starts_at;
+	sim->stats.waiting += sim->ticks - p->__starts_at - p->lifespan;
+
+	pool_free(&sim->__process_pool, p);
 }
 
 
+/**
+ * Move the acquired @rs to the holding list, which is sorted by the ages to
+ * release at. The one acquired earlier comes first among the ties
+ */
+static void __hold_schedule(struct process *p, struct resource_schedule *rs)
+{
+	struct list_head *pos = p->__resources_holding.prev;
+
+	rs->releases_at = p->age + rs->duration;
+
+	while (pos != &p->__resources_holding &&
+			list_entry(pos, struct resource_schedule, list)->releases_at > rs->releases_at) {
+		pos = pos->prev;
+	}
+	list_move(&rs->list, pos);
+}
+
 /**
  * Process resource acqutision
  */
-static bool __run_current_acquire()
+static bool __run_current_acquire(struct sim_context *sim, struct sim_cpu *cpu)
 {
+	struct process *current = cpu->current;
 	struct resource_schedule *rs, *tmp;
 
+	/* Only the ones due now at the head of the sorted schedule */
 	list_for_each_entry_safe(rs, tmp, &current->__resources_to_acquire, list) {
-		if (rs->at == current->age) {
-			assert(sched->acquire && "scheduler.acquire() not implemented");
+		if (rs->at != current->age) break;
 
-			/* Callback to acquire the resource */
-			if (sched->acquire(rs->resource_id)) {
-				list_move_tail(&rs->list, &current->__resources_holding);
+		assert(__sched(sim)->acquire && "scheduler.acquire() not implemented");
 
-				__print_event(current->pid, "+%d", rs->resource_id);
-			} else {
-				return false;
-			}
+		assert(rs->resource_id < sim->nr_resources);
+
+		/* Callback to acquire the resource */
+		if (__sched(sim)->acquire(rs->resource_id)) {
+			__sim_update_resource(sim, rs->resource_id);
+			__sim_hold_resource(sim, current, rs->resource_id);
+			__hold_schedule(current, rs);
+
+			__print_event(cpu, current, TRACE_ACQUIRE, rs->resource_id);
+		} else {
+			__sim_update_resource(sim, rs->resource_id);
+			if (sim->__metrics) current->__metrics->blocked_on = rs->resource_id;
+			return false;
 		}
 	}
 
@@ -294,117 +566,607 @@ static bool __run_current_acquire()
 /**
  * Process resource release
  */
-static void __run_current_release()
+static void __run_current_release(struct sim_context *sim, struct sim_cpu *cpu)
 {
+	struct process *current = cpu->current;
 	struct resource_schedule *rs, *tmp;
 
+	/* Only the ones expiring now at the head of the sorted holding list */
 	list_for_each_entry_safe(rs, tmp, &current->__resources_holding, list) {
-		if (--rs->duration == 0) {
-			assert(sched->release && "scheduler.release() not implemented");
+		if (rs->releases_at != current->age) break;
+
+		assert(__sched(sim)->release && "scheduler.release() not implemented");
+
+		/* Callback the release() */
+		__unhold_resource(current, rs->resource_id);
+		__sched(sim)->release(rs->resource_id);
+		__sim_update_resource(sim, rs->resource_id);
+		sim->__need_resched = true;
+
+		__print_event(cpu, current, TRACE_RELEASE, rs->resource_id);
+
+		list_del(&rs->list);
+		pool_free(&sim->__resource_schedule_pool, rs);
+	}
+}
+
+
+/**
+ * Number of ticks @current can run from now on without any event that
+ * might change the scheduling decision or need the framework's attention;
+ * fork, resource acquisition and release, exit, and preemption. Only a
+ * single processor is simulated this way.
+ */
+static unsigned int __run_horizon(struct sim_context *sim)
+{
+	struct process *current = sim->cpus[0].current;
+	struct resource_schedule *rs;
+	unsigned int horizon;
+
+	if (sim->nr_cpus > 1) return 0;
+
+	if (__sched(sim)->preempt == PREEMPT_TICK &&
+			(sim->__need_resched || !sim->cpus[0].quantum_left)) return 0;
+	if (__sched(sim)->preempt == PREEMPT_EVENT && sim->__need_resched) return 0;
+
+	if (!current || current->status != PROCESS_RUNNING) return 0;
+
+	horizon = current->lifespan - current->age;
+
+	/* The scheduler may switch at the end of the quantum */
+	if (__sched(sim)->preempt == PREEMPT_TICK &&
+			sim->cpus[0].quantum_left < horizon) {
+		horizon = sim->cpus[0].quantum_left;
+	}
+
+	if (!list_empty(&sim->__forkqueue)) {
+		struct process *p =
+				list_first_entry(&sim->__forkqueue, struct process, list);
+		if (p->__starts_at - sim->ticks < horizon) {
+			horizon = p->__starts_at - sim->ticks;
+		}
+	}
+
+	list_for_each_entry(rs, &current->__resources_to_acquire, list) {
+		if (rs->at < current->age) continue;
+
+		if (rs->at - current->age < horizon) {
+			horizon = rs->at - current->age;
+		}
+		break;
+	}
+
+	/* The tick releasing a resource should be simulated as usual */
+	if (!list_empty(&current->__resources_holding)) {
+		rs = list_first_entry(&current->__resources_holding,
+				struct resource_schedule, list);
+		if (rs->releases_at - current->age - 1 < horizon) {
+			horizon = rs->releases_at - current->age - 1;
+		}
+	}
+
+	return horizon;
+}
+
+/**
+ * Run @current for @nr ticks in one step
+ */
+static void __advance_current(struct sim_context *sim, unsigned int nr)
+{
+	struct sim_cpu *cpu = sim->cpus;
+	struct process *current = cpu->current;
+
+	trace_repeat(&sim->__trace, sim->ticks, cpu->id, current->pid, TRACE_RUN, nr);
+	if (sim->__eventlog) {
+		eventlog_event(sim->__eventlog, sim->ticks, cpu->id, current->pid,
+				TRACE_RUN, nr, current->prio);
+	}
 
-			/* Callback the release() */
-			sched->release(rs->resource_id);
+	current->age += nr;
+	cpu->quantum_left = nr < cpu->quantum_left ? cpu->quantum_left - nr : 0;
 
-			__print_event(current->pid, "-%d", rs->resource_id);
+	sim->ticks += nr;
+}
 
-			list_del(&rs->list);
-			free(rs);
+/**
+ * Trace @nr idle ticks of all processors from now on
+ */
+static void __trace_idle(struct sim_context *sim, unsigned int nr)
+{
+	if (sim->__eventlog) {
+		for (unsigned int i = 0; i < sim->nr_cpus; i++) {
+			eventlog_event(sim->__eventlog, sim->ticks, i, 0, TRACE_IDLE, nr, 0);
+		}
+	}
+
+	if (sim->nr_cpus == 1 || sim->__trace.compress) {
+		for (unsigned int i = 0; i < sim->nr_cpus; i++) {
+			trace_repeat(&sim->__trace, sim->ticks, i, 0, TRACE_IDLE, nr);
+		}
+		return;
+	}
+
+	/* Keep the records in the order of ticks */
+	for (unsigned int t = 0; t < nr; t++) {
+		for (unsigned int i = 0; i < sim->nr_cpus; i++) {
+			trace_event(&sim->__trace, sim->ticks + t, i, 0, TRACE_IDLE, 0);
 		}
 	}
 }
 
 
-/***********************************************************************
- * The main loop for the scheduler simulation
+/**
+ * Migrate a ready process to the idle @cpu from the processor with the most
+ * processes to run
  */
-static void __do_simulation(void)
+static struct process *__steal_process(struct sim_context *sim, struct sim_cpu *cpu)
 {
-	assert(sched->schedule && "scheduler.schedule() not implemented");
+	struct sim_cpu *victim = NULL;
+	struct process *p = NULL;
+
+	for (unsigned int i = 1; i < sim->nr_cpus; i++) {
+		struct sim_cpu *c = sim->cpus + (cpu->id + i) % sim->nr_cpus;
 
-	while (true) {
-		struct process *prev;
+		/* Leave the processor with the last process alone */
+		if (c->nr_running < 2) continue;
 
-		/* Fork processes on schedule */
-		__fork_on_schedule();
+		if (!victim || c->nr_running > victim->nr_running) {
+			victim = c;
+		}
+	}
+	if (!victim) return NULL;
+
+	this_cpu = victim;
+	if (__sched(sim)->steal) {
+		p = __sched(sim)->steal();
+	} else if (!list_empty(&victim->readyqueue)) {
+		p = list_first_entry(&victim->readyqueue, struct process, list);
+		list_del_init(&p->list);
+	}
+	this_cpu = cpu;
 
-		/* Ask scheduler to pick the next process to run */
-		prev = current;
-		current = sched->schedule();
+	if (!p) return NULL;
 
-		/* If the system ran a process in the previous tick, */
-		if (prev) {
-			/* Update the process status */
-			if (prev->status == PROCESS_RUNNING) {
-				prev->status = PROCESS_READY;
-			}
+	assert(p->status == PROCESS_READY);
+
+	victim->nr_running--;
+	cpu->nr_running++;
+	p->cpu = cpu->id;
+
+	return p;
+}
+
+/**
+ * @current of @cpu can run on in its quantum without asking the scheduler.
+ * Nothing that might change the decision should have happened since it was
+ * picked
+ */
+static bool __keep_current(struct sim_context *sim, struct sim_cpu *cpu)
+{
+	struct process *current = cpu->current;
+
+	if (!cpu->quantum_left || sim->__need_resched) return false;
+
+	return current && current->status == PROCESS_RUNNING &&
+			current->age < current->lifespan;
+}
+
+/**
+ * Ask the scheduler to pick the next process to run on @cpu, and retire the
+ * process that ran in the previous tick
+ */
+static void __schedule_cpu(struct sim_context *sim, struct sim_cpu *cpu)
+{
+	struct process *prev = cpu->current;
+
+	if (__keep_current(sim, cpu)) return;
+
+	this_cpu = cpu;
+	cpu->current = __sched(sim)->schedule();
 
-			/* Decommission it if completed */
-			if (prev->age == prev->lifespan) {
-				prev->status = PROCESS_EXIT;
-				__exit_process(prev);
+	/* If the processor ran a process in the previous tick, */
+	if (prev) {
+		/* Update the process status */
+		if (prev->status == PROCESS_RUNNING) {
+			prev->status = PROCESS_READY;
+
+			/* Switched out while it can go on. Wait from now on */
+			if (sim->__metrics && prev != cpu->current) {
+				prev->__metrics->ready_since = sim->ticks;
 			}
 		}
 
-		/* No process is ready to run at this moment */
-		if (!current) {
-			/* Quit simulation if no pending process exists */
-			if (list_empty(&readyqueue) && list_empty(&__forkqueue)) {
-				break;
-			}
+		/* Decommission it if completed */
+		if (prev->age == prev->lifespan) {
+			prev->status = PROCESS_EXIT;
+			__exit_process(sim, cpu, prev);
+		}
+	}
+
+	/* Nothing to run here. Take one from busy processors */
+	if (!cpu->current && sim->nr_cpus > 1) {
+		cpu->current = __steal_process(sim, cpu);
+	}
+
+	/* The quantum starts over unless the scheduler let @prev go on */
+	if (!cpu->quantum_left || cpu->current != prev) {
+		cpu->quantum_left = sim->__quantum;
+	}
+
+	if (sim->__metrics && cpu->current && cpu->current != prev) {
+		struct process_metrics *pm = cpu->current->__metrics;
+
+		if (pm->first_run == UINT_MAX) pm->first_run = sim->ticks;
+		pm->nr_switches++;
+		pm->ready_ticks += sim->ticks - pm->ready_since;
+	}
+}
 
-			/* Idle temporarily */
-			fprintf(stderr, "%3d: idle\n", ticks);
+/**
+ * Execute the current process of @cpu for a tick
+ */
+static void __run_cpu(struct sim_context *sim, struct sim_cpu *cpu)
+{
+	struct process *current = cpu->current;
+
+	this_cpu = cpu;
+
+	/* Idle temporarily */
+	if (!current) {
+		__print_event(cpu, NULL, TRACE_IDLE, 0);
+		return;
+	}
+
+	/* Execute the current process */
+	current->status = PROCESS_RUNNING;
+
+	/* Ensure that @current is detached from any list */
+	assert(list_empty(&current->list));
+
+	/* Try acquiring scheduled resources */
+	if (__run_current_acquire(sim, cpu)) {
+		/* Succesfully acquired all the resources to make a progress! */
+		__print_event(cpu, current, TRACE_RUN, 0);
+
+		/* So, it ages by one tick */
+		current->age++;
+		if (cpu->quantum_left) cpu->quantum_left--;
+
+		/* And performs scheduled releases */
+		__run_current_release(sim, cpu);
+	} else {
+		/**
+		 * The current is blocked while acquiring resource(s).
+		 * In this case, @current could not make a progress in this tick
+		 */
+		__print_event(cpu, current, TRACE_BLOCK, 0);
+
+		/* Thus, it is not get aged nor unable to perform releases */
+		cpu->nr_running--;
+		if (sim->__metrics) current->__metrics->blocked_since = sim->ticks;
+
+		/**
+		 * Another processor may wake it up in this tick, and then it
+		 * is not ours anymore
+		 */
+		if (sim->nr_cpus > 1) cpu->current = NULL;
+	}
+}
+
+static bool __all_readyqueues_empty(struct sim_context *sim)
+{
+	for (unsigned int i = 0; i < sim->nr_cpus; i++) {
+		if (!list_empty(&sim->cpus[i].readyqueue)) return false;
+	}
+	return true;
+}
+
+
+/***********************************************************************
+ * The main loop for the scheduler simulation. Simulate one tick, or more
+ * in the fast-forward and the event-driven modes. Return false when no
+ * process is left to simulate.
+ */
+static bool __do_simulation(struct sim_context *sim)
+{
+	bool idle = true;
+
+	/* Skip the ticks where nothing but running @current happens */
+	if (sim->options.event_driven) {
+		unsigned int nr = __run_horizon(sim);
+		if (nr) {
+			__advance_current(sim, nr);
+			return true;
+		}
+	}
+
+	/* Fork processes on schedule. They may preempt the running ones */
+	if (__fork_on_schedule(sim)) sim->__need_resched = true;
+
+	/* Ask scheduler to pick the next process to run on each processor */
+	for (unsigned int i = 0; i < sim->nr_cpus; i++) {
+		__schedule_cpu(sim, sim->cpus + i);
+		if (sim->cpus[i].current) idle = false;
+	}
+	sim->__need_resched = false;
+
+	/* No process is ready to run at this moment */
+	if (idle) {
+		/* Quit simulation if no pending process exists */
+		if (__all_readyqueues_empty(sim) && list_empty(&sim->__forkqueue)) {
+			return false;
+		}
+
+		/**
+		 * Nothing can happen until the next fork if no process is
+		 * ready. Jump to the tick right before the fork
+		 */
+		if (sim->options.fast_forward && __all_readyqueues_empty(sim) &&
+				!list_empty(&sim->__forkqueue)) {
+			unsigned int nr = list_first_entry(&sim->__forkqueue,
+					struct process, list)->__starts_at - sim->ticks;
+
+			__trace_idle(sim, nr);
+			sim->ticks += nr - 1;
 			goto next;
 		}
+	}
 
-		/* Execute the current process */
-		current->status = PROCESS_RUNNING;
+	for (unsigned int i = 0; i < sim->nr_cpus; i++) {
+		__run_cpu(sim, sim->cpus + i);
+	}
 
-		/* Ensure that @current is detached from any list */
-		assert(list_empty(&current->list));
+next:
+	/* Increase the tick counter */
+	sim->ticks++;
+	return true;
+}
 
-		/* Try acquiring scheduled resources */
-		if (__run_current_acquire()) {
-			/* Succesfully acquired all the resources to make a progress! */
-			__print_event(current->pid, "%d", current->pid);
+bool sim_step(struct sim_context *sim)
+{
+	struct sim_context *prev_sim = this_sim;
+	struct sim_cpu *prev_cpu = this_cpu;
 
-			/* So, it ages by one tick */
-			current->age++;
+	if (sim->__finished) return false;
 
-			/* And performs scheduled releases */
-			__run_current_release();
-		} else {
-			/**
-			 * The current is blocked while acquiring resource(s).
-			 * In this case, @current could not make a progress in this tick
-			 */
-			__print_event(current->pid, "=");
+	this_sim = sim;
+	if (!__do_simulation(sim)) {
+		sim->__finished = true;
+	}
+	this_sim = prev_sim;
+	this_cpu = prev_cpu;
+
+	return !sim->__finished;
+}
+
+bool sim_run_until(struct sim_context *sim, unsigned int tick)
+{
+	struct sim_context *prev_sim = this_sim;
+	struct sim_cpu *prev_cpu = this_cpu;
 
-			/* Thus, it is not get aged nor unable to perform releases */
+	this_sim = sim;
+	while (!sim->__finished && sim->ticks < tick) {
+		if (!__do_simulation(sim)) {
+			sim->__finished = true;
 		}
+	}
+	this_sim = prev_sim;
+	this_cpu = prev_cpu;
 
-next:
-		/* Increase the tick counter */
-		ticks++;
+	return !sim->__finished;
+}
+
+
+/**
+ * Do not lose the buffered trace when the simulation hits an assertion, nor
+ * the recorded statuses when it crashes or is signalled to quit as well
+ */
+static void __flush_on_abort(int signo)
+{
+	signal(signo, SIG_DFL);
+
+	if (this_sim) {
+		trace_flush(&this_sim->__trace);
+		if (this_sim->__recorder) recorder_print(this_sim->__recorder);
 	}
+
+	raise(signo);
 }
 
+/**
+ * Nor when it quits on an error while it is running
+ */
+static void __flush_on_exit(void)
+{
+	if (!this_sim) return;
+
+	trace_flush(&this_sim->__trace);
+	if (this_sim->__recorder) recorder_print(this_sim->__recorder);
+	if (this_sim->__eventlog) {
+		eventlog_close(this_sim->__eventlog, NULL);
+		this_sim->__eventlog = NULL;
+	}
+}
 
-static void __initialize(void)
+/**
+ * Call finalize() for the first @nr processors of @sim
+ */
+static void __finalize_cpus(struct sim_context *sim, unsigned int nr)
 {
-	INIT_LIST_HEAD(&readyqueue);
+	struct sim_context *prev_sim = this_sim;
+	struct sim_cpu *prev_cpu = this_cpu;
+
+	this_sim = sim;
+	for (unsigned int i = 0; i < nr; i++) {
+		this_cpu = sim->cpus + i;
+		if (__sched(sim)->finalize) __sched(sim)->finalize();
+	}
+	this_sim = prev_sim;
+	this_cpu = prev_cpu;
+}
+
+static void __free_context(struct sim_context *sim)
+{
+	pool_destroy(&sim->__process_pool);
+	pool_destroy(&sim->__resource_schedule_pool);
+	pool_destroy(&sim->__waitqueue_pool);
+	pool_destroy(&sim->__donation_pool);
+	if (sim->__metrics) metrics_destroy(sim->__metrics);
+	if (sim->__profile) profile_destroy(sim->__profile);
+	if (sim->__eventlog) eventlog_close(sim->__eventlog, NULL);
+	if (sim->__recorder) recorder_destroy(sim->__recorder);
+	trace_fini(&sim->__trace);
+	free(sim->resources);
+	free(sim->__active_resources);
+	free(sim->cpus);
+	free(sim);
+}
+
+struct sim_context *sim_create(const struct scheduler *sched,
+		const struct sim_options *options)
+{
+	static bool handlers_installed = false;
+	static bool recorder_handlers_installed = false;
+	struct sim_context *sim;
+	struct sim_context *prev_sim = this_sim;
+	struct sim_cpu *prev_cpu = this_cpu;
+	void *cpus;
+
+	assert(sched->schedule && "scheduler.schedule() not implemented");
+
+#ifdef SIM_SCHEDULER
+	if (sched != &SIM_SCHEDULER) {
+		fprintf(stderr, "This build only simulates %s scheduler\n",
+				SIM_SCHEDULER.name);
+		return NULL;
+	}
+	if (options->profile) {
+		fprintf(stderr, "Profiling is not available in this build\n");
+		return NULL;
+	}
+#endif
 
-	for (int i = 0; i < NR_RESOURCES; i++) {
-		resources[i].owner = NULL;
-		INIT_LIST_HEAD(&(resources[i].waitqueue));
+	sim = calloc(1, sizeof(*sim));
+	if (!sim) {
+		fprintf(stderr, "Cannot allocate the simulation context\n");
+		return NULL;
 	}
 
-	INIT_LIST_HEAD(&__forkqueue);
+	sim->sched = sched;
+	sim->options = *options;
+	sim->__quantum = options->quantum ? options->quantum :
+			sched->quantum ? sched->quantum : 1;
+
+	sim->nr_cpus = options->nr_cpus ? options->nr_cpus : 1;
+	if (posix_memalign(&cpus, SMP_CACHE_BYTES, sizeof(*sim->cpus) * sim->nr_cpus)) {
+		fprintf(stderr, "Cannot allocate %u processors\n", sim->nr_cpus);
+		free(sim);
+		return NULL;
+	}
+	sim->cpus = cpus;
 
-	if (quiet) return;
+	for (unsigned int i = 0; i < sim->nr_cpus; i++) {
+		struct sim_cpu *cpu = sim->cpus + i;
+
+		cpu->id = i;
+		cpu->current = NULL;
+		INIT_LIST_HEAD(&cpu->readyqueue);
+		cpu->sched_data = NULL;
+		cpu->nr_running = 0;
+		cpu->quantum_left = 0;
+	}
+
+	if (trace_init(&sim->__trace, options->trace_fd)) {
+		fprintf(stderr, "Cannot allocate the trace buffer\n");
+		free(sim->cpus);
+		free(sim);
+		return NULL;
+	}
+	sim->__trace.compress = options->compress_trace;
+	sim->__trace.compact = options->compact_trace;
+	sim->__trace.digest = options->digest_trace;
+	sim->__trace.show_cpu = sim->nr_cpus > 1;
+
+	if (!handlers_installed) {
+		signal(SIGABRT, __flush_on_abort);
+		atexit(__flush_on_exit);
+		handlers_installed = true;
+	}
+
+	INIT_LIST_HEAD(&sim->__forkqueue);
+	sim->__forkqueue_sorted = true;
+
+	pool_init(&sim->__process_pool, "process", sizeof(struct process));
+	pool_init(&sim->__resource_schedule_pool, "resource_schedule",
+			sizeof(struct resource_schedule));
+	pool_init(&sim->__waitqueue_pool, "prio_waitqueue",
+			sizeof(struct prio_waitqueue));
+	pool_init(&sim->__donation_pool, "process_donations",
+			sizeof(struct process_donations));
+
+	if (options->report_metrics || options->metrics_file) {
+		sim->__metrics = metrics_create(options->metrics_file,
+				options->metrics_json, sched->name);
+		if (!sim->__metrics) {
+			__free_context(sim);
+			return NULL;
+		}
+	}
+
+	if (options->eventlog_file) {
+		sim->__eventlog = eventlog_open(options->eventlog_file,
+				options->eventlog_json);
+		if (!sim->__eventlog) {
+			__free_context(sim);
+			return NULL;
+		}
+	}
+
+	if (options->flight_recorder && !options->silent_status) {
+		sim->__recorder = recorder_create(options->flight_recorder);
+		if (!sim->__recorder) {
+			fprintf(stderr, "Cannot allocate the flight recorder\n");
+			__free_context(sim);
+			return NULL;
+		}
+		if (!recorder_handlers_installed) {
+			signal(SIGSEGV, __flush_on_abort);
+			signal(SIGINT, __flush_on_abort);
+			signal(SIGTERM, __flush_on_abort);
+			recorder_handlers_installed = true;
+		}
+	}
+
+	/* Call the scheduler through the profiling wrappers */
+	if (options->profile) {
+		sim->__profile = profile_create(sched);
+		if (!sim->__profile) {
+			__free_context(sim);
+			return NULL;
+		}
+		sim->sched = &sim->__profile->sched;
+	}
+
+	this_sim = sim;
+	for (unsigned int i = 0; i < sim->nr_cpus; i++) {
+		this_cpu = sim->cpus + i;
+		if (sched->initialize && sched->initialize()) {
+			this_sim = prev_sim;
+			this_cpu = prev_cpu;
+			__finalize_cpus(sim, i);
+			__free_context(sim);
+			return NULL;
+		}
+	}
+	this_sim = prev_sim;
+	this_cpu = prev_cpu;
+
+	if (options->quiet) return sim;
 	printf("**************************************************************\n");
 	printf("*\n");
-	printf("*   Simulating %s scheduler\n", sched->name);
+	printf("*   Simulating %s scheduler", sched->name);
+	if (sim->nr_cpus > 1) printf(" on %u processors", sim->nr_cpus);
+	printf("\n");
 	printf("*\n");
 	printf("**************************************************************\n");
 	printf("   N: Forked\n");
@@ -412,89 +1174,110 @@ static void __initialize(void)
 	printf("   =: Blocked\n");
 	printf("  +n: Acquire resource n\n");
 	printf("  -n: Release resource n\n");
+	if (sim->nr_cpus > 1) printf(" [n]: On processor n\n");
 	printf("\n");
+	return sim;
 }
 
-
-static void __print_usage(char * const name)
+unsigned long long sim_nr_events(struct sim_context *sim)
 {
-	printf("Usage: %s {-q} -[f|s|S|r|p|i] [process script file]\n", name);
-	printf("\n");
-	printf("  -q: Run quietly\n\n");
-	printf("  -f: Use FIFO scheduler (default)\n");
-	printf("  -s: Use SJF scheduler\n");
-	printf("  -S: Use SRTF scheduler\n");
-	printf("  -r: Use Round-robin scheduler\n");
-	printf("  -p: Use Priority scheduler\n");
-	printf("  -c: Use Priority with PCP scheduler\n");
-	printf("  -i: Use Priority with PIP scheduler\n");
-	printf("\n");
+	return sim->__trace.nr_events;
 }
 
+const struct sim_metrics *sim_metrics(struct sim_context *sim)
+{
+	return sim->__metrics;
+}
 
-int main(int argc, char * const argv[])
+static void __report_pool(struct pool *pool)
 {
-	int opt;
-	char *scriptfile;
+	printf("  %-18s %10lu live %10lu peak %6lu slabs (%zu bytes each)\n",
+			pool->name, pool->nr_live, pool->nr_peak,
+			pool->nr_slabs, pool->slab_size);
+}
 
-	while ((opt = getopt(argc, argv, "qfsSrpich")) != -1) {
-		switch (opt) {
-		case 'q':
-			quiet = true;
-			break;
+static void __free_held_resources(struct process *p)
+{
+	free(p->held_resources);
+	p->held_resources = NULL;
+}
 
-		case 'f':
-			sched = &fifo_scheduler;
-			break;
-		case 's':
-			sched = &sjf_scheduler;
-			break;
-		case 'S':
-			sched = &srtf_scheduler;
-			break;
-		case 'r':
-			sched = &rr_scheduler;
-			break;
-		case 'p':
-			sched = &prio_scheduler;
-			break;
-		case 'i':
-			sched = &pip_scheduler;
-			break;
-		case 'c':
-			sched = &pcp_scheduler;
-			break;
-		case 'h':
-		default:
-			__print_usage(argv[0]);
-			return EXIT_FAILURE;
-		}
+bool sim_destroy(struct sim_context *sim)
+{
+	unsigned long long nr_events, nr_bytes;
+	struct eventlog_stats log_stats;
+	bool logged = sim->__eventlog != NULL;
+	bool quiet = sim->options.quiet;
+	bool traced;
+	unsigned int i;
+
+	__finalize_cpus(sim, sim->nr_cpus);
+
+	if (sim->__trace.digest) trace_write_digest(&sim->__trace);
+	trace_flush(&sim->__trace);
+	if (sim->__recorder) recorder_print(sim->__recorder);
+	nr_events = sim->__trace.nr_events;
+	nr_bytes = sim->__trace.nr_bytes;
+	traced = !sim->__trace.failed;
+
+	if (logged) {
+		eventlog_close(sim->__eventlog, &log_stats);
+		sim->__eventlog = NULL;
 	}
 
-	if (optind >= argc) {
-		__print_usage(argv[0]);
-		return EXIT_FAILURE;
+	if (sim->options.report_memory) {
+		printf("\n");
+		printf("Memory pools:\n");
+		__report_pool(&sim->__process_pool);
+		__report_pool(&sim->__resource_schedule_pool);
+		__report_pool(&sim->__waitqueue_pool);
+		__report_pool(&sim->__donation_pool);
 	}
 
-	scriptfile = argv[optind];
+	if (sim->options.report_metrics) metrics_report(sim->__metrics);
+	if (sim->__profile) profile_report(sim->__profile);
 
-	__initialize();
+	/**
+	 * Processes left over hold or wait for resources, and may still have
+	 * their held ids allocated
+	 */
+	bitmap_for_each_set(i, sim->__active_resources, sim->nr_resources) {
+		struct resource *r = sim->resources + i;
+		struct process *p;
+		int prio;
 
-	if (!__load_script(scriptfile)) {
-		return EXIT_FAILURE;
-	}
+		if (r->owner) __free_held_resources(r->owner);
 
-	if (sched->initialize && sched->initialize()) {
-		return EXIT_FAILURE;
+		list_for_each_entry(p, &r->waitqueue, list) {
+			__free_held_resources(p);
+		}
+		if (r->prio_waitqueue) {
+			prio_waitqueue_for_each_entry(p, r->prio_waitqueue, prio) {
+				__free_held_resources(p);
+			}
+		}
 	}
 
-	__do_simulation();
+	__sim_unload(sim);
+	__free_context(sim);
 
-	if (sched->finalize) {
-		sched->finalize();
+	if (!quiet) {
+		printf("\n");
+		printf("Traced %llu events in %llu bytes\n", nr_events, nr_bytes);
 	}
-
-	return EXIT_SUCCESS;
+	if (!quiet && logged) {
+		printf("Logged %llu records in %llu bytes", log_stats.nr_records,
+				log_stats.nr_bytes);
+		if (log_stats.nr_stalls) {
+			printf(", waiting for the writer %llu times for %.2f ms",
+					log_stats.nr_stalls, log_stats.stalled_ns / 1e6);
+		}
+		printf("\n");
+	}
+	if (logged && log_stats.failed) {
+		fprintf(stderr, "Cannot write all the event log\n");
+	}
+	return traced && !(logged && log_stats.failed);
 }
 /*          ******        DO NOT MODIFY THIS FILE        ******       */
 /*====================================================================*/
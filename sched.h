@@ -16,6 +16,26 @@
 #ifndef __SCHED_H__
 #define __SCHED_H__
 
+/***********************************************************************
+ * enum preemption
+ *
+ * DESCRIPTION
+ *   When a scheduler may pick a process other than the running one.
+ *
+ *   PREEMPT_TICK: On any tick, such as round-robin. This is the default.
+ *   PREEMPT_EVENT: Only when a process is forked or woken up, or @current
+ *                  gets blocked or exits. SRTF is the example.
+ *   PREEMPT_NONE: Only when @current gets blocked or exits, such as FIFO.
+ */
+enum preemption {
+	PREEMPT_TICK = 0,
+	PREEMPT_EVENT,
+	PREEMPT_NONE,
+};
+
+/* Words of the state a scheduler may save for a process or a processor */
+#define SCHED_STATE_WORDS	3
+
 /***********************************************************************
  * struct scheduler
  *
@@ -27,12 +47,31 @@
 struct scheduler {
 	const char *name;
 
+	/**
+	 * When the scheduler might preempt @current. The event-driven mode
+	 * of the framework relies on this to skip calling schedule() while the
+	 * decision cannot change. Leaving this field zero (PREEMPT_TICK) is
+	 * always safe.
+	 */
+	enum preemption preempt;
+
+	/**
+	 * Ticks of the time slice. Once schedule() picks a process, the
+	 * framework keeps running it for this many ticks without asking again
+	 * unless a process is forked or woken up, or it gets blocked or exits.
+	 * See @quantum_left of struct sim_cpu for the former. The quantum option
+	 * of the simulation overrides this. Zero means one tick, so schedule()
+	 * is called on every tick.
+	 */
+	unsigned int quantum;
+
 	/***********************************************************************
 	 * int initialize(void)
 	 *
 	 * DESCRIPTION
 	 *   Call-back function for your own initialization code. It is OK to
-	 *   leave this field NULL if you don't need any initialization.
+	 *   leave this field NULL if you don't need any initialization. It is
+	 *   called for each processor in turn with @this_cpu set.
 	 *
 	 * RETURN VALUE
 	 *   Return 0 on successful initialization.
@@ -46,7 +85,8 @@ struct scheduler {
 	 *
 	 * DESCRIPTION
 	 *   Callback function for finalizing your code. Like @initialize(),
-	 *   you may leave this function NULL.
+	 *   you may leave this function NULL, and it is called for each
+	 *   processor.
 	 */
 	void (*finalize)(void);
 
@@ -84,6 +124,9 @@ struct scheduler {
 	 *   resources), however, you should not put it back into the ready queue
 	 *   since it is not ready (but is waiting for the resource)!!
 	 *
+	 *   With more than one processor, it is called for each processor in
+	 *   turn, and @current and @readyqueue are those of @this_cpu.
+	 *
 	 * RETURN
 	 *   process to run next
 	 *   NULL if there is no available process to schedule
@@ -111,6 +154,80 @@ struct scheduler {
 	 *   Callbacked to release the resource @resource_id
 	 */
 	void (*release)(int);
+
+
+	/***********************************************************************
+	 * void dump(void)
+	 *
+	 * DESCRIPTION
+	 *   Called by dump_status() to print the processes that are ready to run
+	 *   but kept in the scheduler's own run queue instead of @readyqueue.
+	 *   Use dump_process() to print each process. Leave this NULL if the
+	 *   scheduler only uses @readyqueue.
+	 */
+	void (*dump)(void);
+
+
+	/***********************************************************************
+	 * int select_cpu(struct process *process, bool wakeup)
+	 *
+	 * DESCRIPTION
+	 *   Pick the processor to put @process on when it is forked, or woken up
+	 *   if @wakeup is true. @process->cpu is the processor it was on before.
+	 *   Leave this NULL to pick the processor with the fewest processes to
+	 *   run, preferring @process->cpu on the tie.
+	 *
+	 * RETURN
+	 *   The id of the processor
+	 */
+	int (*select_cpu)(struct process *, bool);
+
+
+	/***********************************************************************
+	 * struct process *steal(void)
+	 *
+	 * DESCRIPTION
+	 *   Take a ready process out of the run queue of @this_cpu to migrate it
+	 *   to an idle processor. Leave this NULL if the scheduler only uses
+	 *   @readyqueue, and the first one there is taken.
+	 *
+	 * RETURN
+	 *   The process to migrate, or NULL if there is none to give
+	 */
+	struct process *(*steal)(void);
+
+
+	/***********************************************************************
+	 * void for_each_ready(void (*fn)(struct process *, void *), void *data)
+	 *
+	 * DESCRIPTION
+	 *   Call @fn with @data for each process kept in the scheduler's own run
+	 *   queue of @this_cpu, in the order they would be picked to run. The
+	 *   checkpoint of the simulation saves them in this order, and restoring
+	 *   puts them back through forked() in the same order. Leave this NULL
+	 *   if the scheduler only uses @readyqueue.
+	 */
+	void (*for_each_ready)(void (*fn)(struct process *, void *), void *data);
+
+
+	/***********************************************************************
+	 * bool save(struct process *process, unsigned long long state[])
+	 * void restore(struct process *process, const unsigned long long state[])
+	 *
+	 * DESCRIPTION
+	 *   Save up to SCHED_STATE_WORDS words of the state the scheduler keeps
+	 *   for @process into @state when the simulation is checkpointed, and
+	 *   give it back when the snapshot is restored with the same scheduler.
+	 *   With @process NULL, they are about @this_cpu. restore() is called for
+	 *   each processor first, and then for each process before it is put
+	 *   back into the queues. Leave them NULL if the scheduler keeps nothing
+	 *   but the order of the queues.
+	 *
+	 * RETURN
+	 *   save() returns false if there is nothing to save
+	 */
+	bool (*save)(struct process *, unsigned long long state[]);
+	void (*restore)(struct process *, const unsigned long long state[]);
 };
 
 #endif
@@ -0,0 +1,370 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/**
+ * Generator of synthetic process scripts to measure the simulator with.
+ * The processes are written in the order of their start ticks, so the
+ * script can be streamed with -L as well.
+ *
+ * Each process holds at most one resource at a time; its lifespan is cut
+ * into as many slots as the resources it acquires, and each acquisition
+ * is released within its slot. Thus the workloads never deadlock.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "types.h"
+#include "list_head.h"
+#include "process.h"
+#include "resource.h"
+
+enum distribution {
+	DIST_FIXED,
+	DIST_UNIFORM,
+	DIST_EXP,
+	DIST_BURST,
+};
+
+static const char * const __distribution_names[] = {
+	"fixed", "uniform", "exp", "burst",
+};
+
+struct options {
+	unsigned long nr_processes;
+	unsigned long long seed;
+
+	enum distribution arrival;
+	double interarrival;		/* Mean ticks between forks */
+	unsigned int burst;			/* # of processes forked at once in DIST_BURST */
+
+	enum distribution lifespan;
+	double mean_lifespan;
+
+	unsigned int prio_spread;	/* Priorities are in 0 .. @prio_spread */
+
+	unsigned int nr_resources;
+	unsigned int nr_acquires;	/* Max acquisitions per process */
+	double skew;				/* Zipf exponent of the resource popularity */
+};
+
+/**
+ * splitmix64. The same seed gives the same script on any host
+ */
+static unsigned long long __state;
+
+static unsigned long long __rand(void)
+{
+	unsigned long long z = (__state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* In [0, 1) */
+static double __uniform(void)
+{
+	return (__rand() >> 11) * (1.0 / (1ULL << 53));
+}
+
+static unsigned long long __below(unsigned long long n)
+{
+	return n ? __rand() % n : 0;
+}
+
+static double __exponential(double mean)
+{
+	return -mean * log(1.0 - __uniform());
+}
+
+/**
+ * Sample resources by the Zipf distribution with the precomputed
+ * cumulative @cdf of @nr entries
+ */
+static unsigned int __zipf(const double *cdf, unsigned int nr)
+{
+	double u = __uniform() * cdf[nr - 1];
+	unsigned int lo = 0, hi = nr - 1;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (cdf[mid] <= u) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static double *__build_zipf(unsigned int nr, double skew)
+{
+	double *cdf = malloc(sizeof(*cdf) * nr);
+	double sum = 0;
+
+	if (!cdf) return NULL;
+
+	for (unsigned int i = 0; i < nr; i++) {
+		sum += 1.0 / pow(i + 1, skew);
+		cdf[i] = sum;
+	}
+	return cdf;
+}
+
+static unsigned int __lifespan(const struct options *opts)
+{
+	double lifespan;
+
+	switch (opts->lifespan) {
+	case DIST_UNIFORM:
+		lifespan = 1 + __below((unsigned long long)(2 * opts->mean_lifespan - 1));
+		break;
+	case DIST_EXP:
+		lifespan = 1 + __exponential(opts->mean_lifespan - 1);
+		break;
+	default:
+		lifespan = opts->mean_lifespan;
+		break;
+	}
+	return lifespan >= 1 ? (unsigned int)lifespan : 1;
+}
+
+static int __compare_ticks(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Start ticks of all processes, in the ascending order
+ */
+static unsigned int *__arrivals(const struct options *opts)
+{
+	unsigned int *starts = malloc(sizeof(*starts) * opts->nr_processes);
+	double now = 0;
+
+	if (!starts) return NULL;
+
+	switch (opts->arrival) {
+	case DIST_UNIFORM: {
+		double span = opts->interarrival * opts->nr_processes;
+
+		for (unsigned long i = 0; i < opts->nr_processes; i++) {
+			starts[i] = __uniform() * span;
+		}
+		qsort(starts, opts->nr_processes, sizeof(*starts), __compare_ticks);
+		break;
+	}
+	case DIST_BURST:
+		for (unsigned long i = 0; i < opts->nr_processes; i++) {
+			if (i && i % opts->burst == 0) {
+				now += __exponential(opts->interarrival * opts->burst);
+			}
+			starts[i] = now;
+		}
+		break;
+	case DIST_EXP:
+		for (unsigned long i = 0; i < opts->nr_processes; i++) {
+			starts[i] = now;
+			now += __exponential(opts->interarrival);
+		}
+		break;
+	default:
+		for (unsigned long i = 0; i < opts->nr_processes; i++) {
+			starts[i] = i * opts->interarrival;
+		}
+		break;
+	}
+	return starts;
+}
+
+static void __write_process(FILE *out, const struct options *opts,
+		unsigned long pid, unsigned int start, const double *cdf)
+{
+	unsigned int lifespan = __lifespan(opts);
+	unsigned int nr_acquires = 0;
+
+	fprintf(out, "process %lu\n", pid);
+	fprintf(out, "\tstart %u\n", start);
+	fprintf(out, "\tlifespan %u\n", lifespan);
+	fprintf(out, "\tprio %llu\n", __below(opts->prio_spread + 1));
+
+	if (opts->nr_resources && opts->nr_acquires) {
+		nr_acquires = __below(opts->nr_acquires + 1);
+		if (nr_acquires > lifespan) nr_acquires = lifespan;
+	}
+
+	/* One acquisition in each slot of the lifespan */
+	for (unsigned int i = 0; i < nr_acquires; i++) {
+		unsigned int begin = (unsigned long long)lifespan * i / nr_acquires;
+		unsigned int end = (unsigned long long)lifespan * (i + 1) / nr_acquires;
+		unsigned int at = begin + __below(end - begin);
+		unsigned int duration = 1 + __below(end - at);
+
+		fprintf(out, "\tacquire %u %u %u\n",
+				__zipf(cdf, opts->nr_resources), at, duration);
+	}
+
+	fprintf(out, "end\n\n");
+}
+
+static bool __parse_distribution(const char *str, enum distribution *dist)
+{
+	for (int i = 0; i < sizeof(__distribution_names) / sizeof(__distribution_names[0]); i++) {
+		if (strcmp(str, __distribution_names[i]) == 0) {
+			*dist = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void __print_usage(char * const name)
+{
+	printf("Usage: %s -n [processes] {options}\n", name);
+	printf("\n");
+	printf("  -n: Number of processes to generate\n");
+	printf("  -s: Seed of the random numbers (1 by default)\n");
+	printf("  -a: Arrival of processes; fixed, uniform, exp, or burst (exp by default)\n");
+	printf("  -i: Mean ticks between arrivals (10 by default)\n");
+	printf("  -b: Processes forked at once in the burst arrival (16 by default)\n");
+	printf("  -l: Lifespan of processes; fixed, uniform, or exp (exp by default)\n");
+	printf("  -m: Mean lifespan (8 by default)\n");
+	printf("  -p: Priorities are spread in 0 .. [spread] (%d by default)\n", MAX_PRIO);
+	printf("  -r: Number of resources (0 by default)\n");
+	printf("  -A: Max resources that a process acquires in its lifespan (2 by default)\n");
+	printf("  -k: Zipf exponent of the resource popularity, 0 for uniform (1 by default)\n");
+	printf("  -o: Write to the file instead of the standard output\n");
+	printf("\n");
+}
+
+int main(int argc, char * const argv[])
+{
+	struct options opts = {
+		.seed = 1,
+		.arrival = DIST_EXP,
+		.interarrival = 10,
+		.burst = 16,
+		.lifespan = DIST_EXP,
+		.mean_lifespan = 8,
+		.prio_spread = MAX_PRIO,
+		.nr_acquires = 2,
+		.skew = 1,
+	};
+	const char *filename = NULL;
+	FILE *out = stdout;
+	unsigned int *starts;
+	double *cdf = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:a:i:b:l:m:p:r:A:k:o:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			opts.nr_processes = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			opts.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'a':
+			if (!__parse_distribution(optarg, &opts.arrival)) goto usage;
+			break;
+		case 'i':
+			opts.interarrival = atof(optarg);
+			break;
+		case 'b':
+			opts.burst = atoi(optarg);
+			if (opts.burst < 1) opts.burst = 1;
+			break;
+		case 'l':
+			if (!__parse_distribution(optarg, &opts.lifespan) ||
+					opts.lifespan == DIST_BURST) goto usage;
+			break;
+		case 'm':
+			opts.mean_lifespan = atof(optarg);
+			break;
+		case 'p':
+			opts.prio_spread = atoi(optarg);
+			if (opts.prio_spread > MAX_PRIO) opts.prio_spread = MAX_PRIO;
+			break;
+		case 'r':
+			opts.nr_resources = atoi(optarg);
+			if (opts.nr_resources > MAX_RESOURCES) opts.nr_resources = MAX_RESOURCES;
+			break;
+		case 'A':
+			opts.nr_acquires = atoi(optarg);
+			break;
+		case 'k':
+			opts.skew = atof(optarg);
+			break;
+		case 'o':
+			filename = optarg;
+			break;
+		case 'h':
+		default:
+			goto usage;
+		}
+	}
+
+	if (!opts.nr_processes || opts.mean_lifespan < 1 || opts.interarrival < 0) {
+		goto usage;
+	}
+
+	__state = opts.seed;
+
+	if (filename) {
+		out = fopen(filename, "w");
+		if (!out) {
+			fprintf(stderr, "Cannot open %s\n", filename);
+			return EXIT_FAILURE;
+		}
+	}
+	setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+	if (opts.nr_resources) {
+		cdf = __build_zipf(opts.nr_resources, opts.skew);
+		if (!cdf) goto out_of_memory;
+	}
+
+	starts = __arrivals(&opts);
+	if (!starts) goto out_of_memory;
+
+	for (unsigned long i = 0; i < opts.nr_processes; i++) {
+		__write_process(out, &opts, i + 1, starts[i], cdf);
+	}
+
+	free(starts);
+	free(cdf);
+
+	if (fclose(out)) {
+		fprintf(stderr, "Cannot write the script\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+
+out_of_memory:
+	fprintf(stderr, "Out of memory\n");
+	return EXIT_FAILURE;
+
+usage:
+	__print_usage(argv[0]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,482 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include "types.h"
+#include "list_head.h"
+#include "process.h"
+#include "resource.h"
+#include "sched.h"
+#include "trace.h"
+#include "pool.h"
+#include "metrics.h"
+#include "profile.h"
+#include "eventlog.h"
+#include "recorder.h"
+
+/**
+ * Options of a simulation
+ */
+struct sim_options {
+	bool quiet;				/* Do not print the briefing nor the banner */
+	bool fast_forward;		/* Jump over idle periods to the next fork */
+	bool compress_trace;	/* Print repeated records as "... xN" */
+	bool compact_trace;		/* Prefix events with pids instead of indenting */
+	bool event_driven;		/* Skip ticks the scheduler need not decide on */
+	bool report_memory;		/* Report the memory pools at the end */
+	bool silent_status;		/* Ignore dump_status() calls */
+	bool report_metrics;	/* Report the scheduling metrics at the end */
+	const char *metrics_file;
+							/* Write the per-process metrics to this file */
+	bool metrics_json;		/* in JSON instead of CSV */
+	bool profile;			/* Profile the scheduler callbacks */
+	unsigned int nr_cpus;	/* # of processors to simulate. 0 means 1 */
+	unsigned int nr_threads;
+							/* # of threads to parse large scripts with.
+							   0 means the online processors */
+	bool digest_trace;		/* Print the digest of the trace instead */
+	unsigned int quantum;	/* Ticks of the time slice. 0 means the
+							   quantum of the scheduler */
+	const char *eventlog_file;
+							/* Log the events into this file */
+	bool eventlog_json;		/* in JSON Lines instead of the records */
+	unsigned int flight_recorder;
+							/* Keep the latest statuses of dump_status() to
+							   print at the end instead of printing each.
+							   0 means printing each */
+	int trace_fd;			/* Where to write the trace to */
+};
+
+/**
+ * Statistics of a simulation, updated as processes exit
+ */
+struct sim_stats {
+	unsigned long nr_forked;		/* # of processes forked */
+	unsigned long nr_exited;		/* # of processes completed */
+	unsigned long long turnaround;	/* Sum of the ticks from fork to exit */
+	unsigned long long waiting;		/* Sum of the ticks not running in between */
+};
+
+/**
+ * Schedule of acquiring a resource in the process script. The schedules of
+ * a process are kept sorted by @at until acquired, and then by @releases_at
+ * while held
+ */
+struct resource_schedule {
+	int resource_id;
+	int at;
+	int duration;
+	int releases_at;	/* The age to release the resource at once acquired */
+	struct list_head list;
+};
+
+struct sim_loader;
+
+/**
+ * Size of the cache line to align the per-CPU data to
+ */
+#define SMP_CACHE_BYTES	64
+
+/**
+ * A processor in the simulated system. Each has its own current process and
+ * ready queue, and is aligned to the cache line so that processors can be
+ * stepped on different threads without false sharing.
+ */
+struct sim_cpu {
+	unsigned int id;
+
+	/**
+	 * The process that is currently running on this processor
+	 */
+	struct process *current;
+
+	/**
+	 * List head to hold the processes ready to run on this processor
+	 */
+	struct list_head readyqueue;
+
+	/**
+	 * Private data of the scheduler for this processor. The scheduler may
+	 * set it in its initialize() callback and release it in finalize().
+	 */
+	void *sched_data;
+
+	/* # of processes ready or running on this processor */
+	unsigned int nr_running;
+
+	/**
+	 * Ticks left in the quantum of @current. schedule() is called with this
+	 * non-zero when a process is forked or woken up in the middle of the
+	 * quantum, and @current keeps the rest if it is picked again.
+	 */
+	unsigned int quantum_left;
+} __attribute__((aligned(SMP_CACHE_BYTES)));
+
+/**
+ * All state of a simulation. Many simulations can run in one program, each
+ * with its own context.
+ */
+struct sim_context {
+	/**
+	 * Processors in the system
+	 */
+	unsigned int nr_cpus;
+	struct sim_cpu *cpus;
+
+	/**
+	 * Number of generated ticks since the simulator was started
+	 */
+	unsigned int ticks;
+
+	/**
+	 * Resources in the system. @resources[id] is the resource @id
+	 */
+	unsigned int nr_resources;
+	struct resource *resources;
+
+	/**
+	 * Scheduler of this simulation
+	 */
+	const struct scheduler *sched;
+
+	struct sim_options options;
+
+	struct sim_stats stats;
+
+
+	/* DO NOT ACCESS FOLLOWING VARIABLES */
+
+	/**
+	 * Processes to fork, in the ascending order of __starts_at. Processes
+	 * with the same start tick are kept in the script order.
+	 */
+	struct list_head __forkqueue;
+	unsigned int __nr_forkqueue;
+	bool __forkqueue_sorted;
+
+	/**
+	 * Processes not in @__forkqueue yet are pulled from this source on
+	 * demand, in the order of their start ticks. NULL if all processes are
+	 * loaded.
+	 */
+	struct process *(*__pull_process)(struct sim_context *);
+	struct sim_loader *__loader;
+
+	/**
+	 * Processes and resource schedules are allocated from the pools, and
+	 * all of them are released at once when the simulation is over
+	 */
+	struct pool __process_pool;
+	struct pool __resource_schedule_pool;
+	struct pool __waitqueue_pool;
+	struct pool __donation_pool;
+
+	struct trace __trace;
+
+	/**
+	 * Bit n is set if resource n is owned or has waiters, so that sweeping
+	 * the resources visits the active ones only
+	 */
+	unsigned long long *__active_resources;
+	unsigned int __max_resources;
+
+	/* Scheduling metrics. NULL if they are not collected */
+	struct sim_metrics *__metrics;
+
+	/* Profile of the callbacks, which @sched points into. NULL if not profiled */
+	struct sim_profile *__profile;
+
+	/* Log of the events. NULL if they are not logged */
+	struct eventlog *__eventlog;
+
+	/* Recorder of the statuses. NULL if dump_status() prints them at once */
+	struct recorder *__recorder;
+
+	/* Ticks of the time slice in effect */
+	unsigned int __quantum;
+
+	/**
+	 * A resource was released in the previous tick, or a process is forked
+	 * in this tick
+	 */
+	bool __need_resched;
+
+	/* No process is left to simulate */
+	bool __finished;
+};
+
+
+/**
+ * The simulation context that the current thread is running. The
+ * simulator API sets this on entry, so the scheduler callbacks can reach
+ * their simulation through it.
+ */
+extern __thread struct sim_context *this_sim;
+
+/**
+ * Likewise, the processor of @this_sim that the scheduler callbacks are
+ * called for
+ */
+extern __thread struct sim_cpu *this_cpu;
+
+
+/**
+ * Assorted schedulers in pa2.c
+ */
+extern const struct scheduler fifo_scheduler;
+extern const struct scheduler sjf_scheduler;
+extern const struct scheduler srtf_scheduler;
+extern const struct scheduler rr_scheduler;
+extern const struct scheduler prio_scheduler;
+extern const struct scheduler pcp_scheduler;
+extern const struct scheduler pip_scheduler;
+extern const struct scheduler cfs_scheduler;
+
+
+/***********************************************************************
+ * sim_create()
+ *
+ * DESCRIPTION
+ *   Create a simulation context to simulate @sched with @options, and
+ *   initialize the scheduler for it.
+ *
+ * RETURN
+ *   The context, or NULL on error
+ */
+struct sim_context *sim_create(const struct scheduler *sched,
+		const struct sim_options *options);
+
+/***********************************************************************
+ * sim_load()
+ *
+ * DESCRIPTION
+ *   Load the process script or the compiled workload @filename into @sim.
+ *   "-" stands for the standard input.
+ *
+ * RETURN
+ *   true on success, false otherwise
+ */
+bool sim_load(struct sim_context *sim, const char *filename);
+
+/***********************************************************************
+ * sim_stream()
+ *
+ * DESCRIPTION
+ *   Like sim_load(), but read the process script only as far as the
+ *   simulation needs. The processes in the script should be sorted by their
+ *   start ticks.
+ */
+bool sim_stream(struct sim_context *sim, const char *filename);
+
+/***********************************************************************
+ * sim_compile()
+ *
+ * DESCRIPTION
+ *   Write the processes loaded into @sim into the compiled workload file
+ *   @filename. See workload.h for the format.
+ */
+bool sim_compile(struct sim_context *sim, const char *filename);
+
+/***********************************************************************
+ * sim_clone()
+ *
+ * DESCRIPTION
+ *   Create a context to simulate the processes loaded into @sim with
+ *   @sched and @options. The processes are copied into the new context, so
+ *   the two can be simulated independently, even on different threads.
+ *   @sim should not have been simulated yet.
+ *
+ * RETURN
+ *   The new context, or NULL on error
+ */
+struct sim_context *sim_clone(struct sim_context *sim,
+		const struct scheduler *sched, const struct sim_options *options);
+
+/**
+ * Perturbation of the processes in a replica. Each of them is moved by up
+ * to the ticks either way, uniformly at random
+ */
+struct sim_jitter {
+	unsigned int start;
+	unsigned int lifespan;
+	unsigned int acquire;	/* The ages to acquire the resources at */
+};
+
+/***********************************************************************
+ * sim_replicate()
+ *
+ * DESCRIPTION
+ *   Like sim_clone(), but perturb the start ticks, the lifespans and the
+ *   ages to acquire resources at of the processes in the new context by
+ *   @jitter. The perturbation is drawn from @seed only, so the same seed
+ *   gives the same replica on any host. Lifespans stay positive and long
+ *   enough to release the resources, and the others do not go below zero.
+ *   Each process acquires the resources in the same order as in @sim, and
+ *   never holds more while acquiring one than it does in @sim.
+ *   The first call loads all processes of @sim as sim_clone() does; the
+ *   later ones only read @sim, so they can be made on different threads at
+ *   once.
+ *
+ * RETURN
+ *   The new context, or NULL on error
+ */
+struct sim_context *sim_replicate(struct sim_context *sim,
+		const struct scheduler *sched, const struct sim_options *options,
+		const struct sim_jitter *jitter, unsigned long long seed);
+
+/***********************************************************************
+ * sim_checkpoint()
+ *
+ * DESCRIPTION
+ *   Write the state of @sim between ticks into the snapshot @filename. See
+ *   snapshot.h for the format. The processes not loaded from the script yet
+ *   are loaded first to be saved as well. The snapshot is written into
+ *   @filename.tmp and then renamed, so an interrupted checkpoint leaves
+ *   the previous snapshot intact.
+ *
+ * RETURN
+ *   true on success, false otherwise
+ */
+bool sim_checkpoint(struct sim_context *sim, const char *filename);
+
+/***********************************************************************
+ * sim_restore()
+ *
+ * DESCRIPTION
+ *   Create a context to simulate on from the snapshot @filename with @sched
+ *   and @options. @sched need not be the scheduler the snapshot was taken
+ *   with. The held resources are acquired again through @sched first, then
+ *   the waiters block on them in the order of their arrival, and then the
+ *   ready processes are handed to @sched with forked() in the order they
+ *   were to be picked. The snapshot sets the number of processors.
+ *
+ * RETURN
+ *   The new context, or NULL on error
+ */
+struct sim_context *sim_restore(const char *filename,
+		const struct scheduler *sched, const struct sim_options *options);
+
+/***********************************************************************
+ * sim_step()
+ *
+ * DESCRIPTION
+ *   Simulate a tick. In the fast-forward and the event-driven modes, a
+ *   step can cover more than one tick.
+ *
+ * RETURN
+ *   true if the simulation can go on, false if it is over
+ */
+bool sim_step(struct sim_context *sim);
+
+/***********************************************************************
+ * sim_run_until()
+ *
+ * DESCRIPTION
+ *   Simulate until @sim->ticks reaches @tick or the simulation is over.
+ *   Pass UINT_MAX to run the simulation to the end.
+ *
+ * RETURN
+ *   Same as sim_step()
+ */
+bool sim_run_until(struct sim_context *sim, unsigned int tick);
+
+/***********************************************************************
+ * sim_destroy()
+ *
+ * DESCRIPTION
+ *   Finalize the scheduler, flush the trace, and release everything in
+ *   @sim.
+ *
+ * RETURN
+ *   false if the trace or the event log could not be written all
+ */
+bool sim_destroy(struct sim_context *sim);
+
+
+/***********************************************************************
+ * sim_nr_events()
+ *
+ * DESCRIPTION
+ *   The number of events traced in @sim so far.
+ */
+unsigned long long sim_nr_events(struct sim_context *sim);
+
+
+/***********************************************************************
+ * sim_metrics()
+ *
+ * DESCRIPTION
+ *   The scheduling metrics collected in @sim so far, or NULL if they are
+ *   not collected.
+ */
+const struct sim_metrics *sim_metrics(struct sim_context *sim);
+
+
+/***********************************************************************
+ * sim_place_process()
+ *
+ * DESCRIPTION
+ *   Pick the processor to put @p on when it is forked or woken up
+ *   (@wakeup), with the select_cpu() callback of the scheduler. The
+ *   scheduler should put @p into the run queue of the returned processor.
+ */
+struct sim_cpu *sim_place_process(struct process *p, bool wakeup);
+
+
+/***********************************************************************
+ * sim_log_prio()
+ *
+ * DESCRIPTION
+ *   Log that the priority of @p is changed from @prio to @p->prio. The
+ *   schedulers changing the priorities of processes call this after the
+ *   change. It does nothing if the events are not logged or the priority
+ *   stays the same.
+ */
+void sim_log_prio(struct process *p, unsigned int prio);
+
+
+/***********************************************************************
+ * sim_prio_waitqueue()
+ *
+ * DESCRIPTION
+ *   The priority-ordered waitqueue of resource @resource_id. It is allocated
+ *   on the first call for the resource, and lives until the simulation is
+ *   destroyed.
+ */
+struct prio_waitqueue *sim_prio_waitqueue(int resource_id);
+
+/***********************************************************************
+ * sim_process_donations()
+ *
+ * DESCRIPTION
+ *   The priorities donated to @p. They are allocated on the first call for
+ *   the process, and released when it exits.
+ */
+struct process_donations *sim_process_donations(struct process *p);
+
+
+/**
+ * Followings are shared by the framework internally
+ */
+void __sim_unload(struct sim_context *sim);
+void __sim_pull_all(struct sim_context *sim);
+bool __sim_reserve_resources(struct sim_context *sim, unsigned int nr_resources);
+void __sim_update_resource(struct sim_context *sim, int resource_id);
+void __sim_hold_resource(struct sim_context *sim, struct process *p,
+		int resource_id);
+
+#endif
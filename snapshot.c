@@ -0,0 +1,749 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+/**
+ * Checkpoint and restore of simulations. See snapshot.h for the format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "types.h"
+#include "list_head.h"
+#include "bitmap.h"
+
+#include "process.h"
+#include "resource.h"
+#include "prio_waitqueue.h"
+
+#include "sim.h"
+#include "snapshot.h"
+
+/**
+ * Snapshot being written. The process records are written as they are
+ * visited, and their schedules are collected to follow the records.
+ */
+struct snapshot_writer {
+	struct sim_context *sim;
+	FILE *file;
+	struct snapshot_header header;
+
+	struct snapshot_schedule *schedules;
+	uint64_t max_schedules;
+
+	unsigned int nr_ready;	/* Ready processes of the processor being saved */
+	bool failed;
+};
+
+static void __save_schedule(struct snapshot_writer *w, struct resource_schedule *rs)
+{
+	if (w->header.nr_schedules == w->max_schedules) {
+		uint64_t max = w->max_schedules ? w->max_schedules * 2 : 1024;
+		struct snapshot_schedule *schedules =
+				realloc(w->schedules, sizeof(*schedules) * max);
+
+		if (!schedules) {
+			w->failed = true;
+			return;
+		}
+		w->schedules = schedules;
+		w->max_schedules = max;
+	}
+
+	w->schedules[w->header.nr_schedules++] = (struct snapshot_schedule) {
+		.resource_id = rs->resource_id,
+		.at = rs->at,
+		.duration = rs->duration,
+		.releases_at = rs->releases_at,
+	};
+}
+
+/**
+ * Save the state the scheduler keeps for @p, or for @cpu if @p is NULL
+ */
+static bool __save_sched_state(struct sim_context *sim, struct sim_cpu *cpu,
+		struct process *p, uint64_t state[])
+{
+	struct sim_context *prev_sim = this_sim;
+	struct sim_cpu *prev_cpu = this_cpu;
+	unsigned long long words[SCHED_STATE_WORDS] = { 0 };
+	bool saved;
+
+	if (!sim->sched->save) return false;
+
+	this_sim = sim;
+	this_cpu = cpu;
+	saved = sim->sched->save(p, words);
+	this_sim = prev_sim;
+	this_cpu = prev_cpu;
+
+	for (unsigned int i = 0; i < SCHED_STATE_WORDS; i++) state[i] = words[i];
+	return saved;
+}
+
+static void __save_process(struct snapshot_writer *w, struct process *p,
+		enum snapshot_state state, int waiting_for)
+{
+	struct snapshot_process sp = {
+		.pid = p->pid,
+		.starts_at = p->__starts_at,
+		.lifespan = p->lifespan,
+		.prio = p->prio_orig,
+		.age = p->age,
+		.state = state,
+		.cpu = p->cpu,
+		.waiting_for = waiting_for,
+		.first_schedule = w->header.nr_schedules,
+	};
+	struct resource_schedule *rs;
+
+	if (state != SNAPSHOT_FORK && w->sim->cpus[p->cpu].current == p) {
+		sp.flags |= SNAPSHOT_CURRENT;
+		sp.quantum_left = w->sim->cpus[p->cpu].quantum_left;
+	}
+	if (state != SNAPSHOT_FORK &&
+			__save_sched_state(w->sim, w->sim->cpus + p->cpu, p, sp.sched_state)) {
+		sp.flags |= SNAPSHOT_SCHED_STATE;
+	}
+
+	list_for_each_entry(rs, &p->__resources_to_acquire, list) {
+		__save_schedule(w, rs);
+		sp.nr_pending++;
+	}
+	list_for_each_entry(rs, &p->__resources_holding, list) {
+		__save_schedule(w, rs);
+		sp.nr_holding++;
+	}
+
+	if (fwrite(&sp, sizeof(sp), 1, w->file) != 1) w->failed = true;
+	w->header.nr_processes++;
+}
+
+static void __save_ready(struct process *p, void *data)
+{
+	struct snapshot_writer *w = data;
+
+	__save_process(w, p, SNAPSHOT_READY, -1);
+	w->nr_ready++;
+}
+
+static int __compare_wait_order(const void *a, const void *b)
+{
+	const struct process *p = *(struct process * const *)a;
+	const struct process *q = *(struct process * const *)b;
+
+	return p->wait_order < q->wait_order ? -1 : p->wait_order > q->wait_order;
+}
+
+/**
+ * Save the processes waiting for resource @resource_id in the order of
+ * arrival
+ */
+static void __save_waiters(struct snapshot_writer *w, int resource_id)
+{
+	struct resource *r = w->sim->resources + resource_id;
+	struct process **waiters;
+	struct process *p;
+	unsigned int nr = 0;
+	int prio;
+
+	list_for_each_entry(p, &r->waitqueue, list) {
+		__save_process(w, p, SNAPSHOT_WAIT, resource_id);
+	}
+
+	if (!r->prio_waitqueue || prio_waitqueue_empty(r->prio_waitqueue)) return;
+
+	prio_waitqueue_for_each_entry(p, r->prio_waitqueue, prio) nr++;
+
+	waiters = malloc(sizeof(*waiters) * nr);
+	if (!waiters) {
+		w->failed = true;
+		return;
+	}
+
+	nr = 0;
+	prio_waitqueue_for_each_entry(p, r->prio_waitqueue, prio) {
+		waiters[nr++] = p;
+	}
+	qsort(waiters, nr, sizeof(*waiters), __compare_wait_order);
+
+	for (unsigned int i = 0; i < nr; i++) {
+		__save_process(w, waiters[i], SNAPSHOT_WAIT, resource_id);
+	}
+	free(waiters);
+}
+
+/**
+ * Save the running and the ready processes of each processor
+ */
+static bool __save_cpus(struct snapshot_writer *w)
+{
+	struct sim_context *sim = w->sim;
+	struct sim_context *prev_sim = this_sim;
+	struct sim_cpu *prev_cpu = this_cpu;
+	bool found = true;
+
+	for (unsigned int i = 0; i < sim->nr_cpus; i++) {
+		struct sim_cpu *cpu = sim->cpus + i;
+
+		if (cpu->current && cpu->current->status == PROCESS_RUNNING) {
+			__save_process(w, cpu->current, SNAPSHOT_RUNNING, -1);
+		}
+	}
+
+	this_sim = sim;
+	for (unsigned int i = 0; i < sim->nr_cpus && found; i++) {
+		struct sim_cpu *cpu = sim->cpus + i;
+		bool running = cpu->current && cpu->current->status == PROCESS_RUNNING;
+		struct process *p;
+
+		w->nr_ready = 0;
+		list_for_each_entry(p, &cpu->readyqueue, list) {
+			__save_ready(p, w);
+		}
+		if (sim->sched->for_each_ready) {
+			this_cpu = cpu;
+			sim->sched->for_each_ready(__save_ready, w);
+		}
+
+		/* All processes ready on the processor should be found */
+		found = w->nr_ready + running == cpu->nr_running;
+	}
+	this_sim = prev_sim;
+	this_cpu = prev_cpu;
+
+	return found;
+}
+
+bool sim_checkpoint(struct sim_context *sim, const char *filename)
+{
+	struct snapshot_writer w = {
+		.sim = sim,
+		.header = {
+			.magic = SNAPSHOT_MAGIC,
+			.version = SNAPSHOT_VERSION,
+		},
+	};
+	char path[PATH_MAX];
+	struct process *p;
+	unsigned int i;
+
+	if (!sim->sched->for_each_ready && (sim->sched->dump || sim->sched->steal)) {
+		fprintf(stderr, "%s scheduler cannot be checkpointed\n", sim->sched->name);
+		return false;
+	}
+
+	/* The processes to fork are saved all */
+	__sim_pull_all(sim);
+
+	/* Write to a temporary file, and replace the snapshot at once */
+	snprintf(path, sizeof(path), "%s.tmp", filename);
+	w.file = fopen(path, "wb");
+	if (!w.file) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return false;
+	}
+
+	/* Leave room for the header, which is written at last */
+	fwrite(&w.header, sizeof(w.header), 1, w.file);
+	w.header.processes_offset = sizeof(w.header);
+
+	list_for_each_entry(p, &sim->__forkqueue, list) {
+		__save_process(&w, p, SNAPSHOT_FORK, -1);
+	}
+
+	if (!__save_cpus(&w)) {
+		fprintf(stderr, "Cannot find all the ready processes of %s scheduler\n",
+				sim->sched->name);
+		w.failed = true;
+	}
+
+	bitmap_for_each_set(i, sim->__active_resources, sim->nr_resources) {
+		__save_waiters(&w, i);
+	}
+
+	w.header.schedules_offset = w.header.processes_offset +
+			(uint64_t)w.header.nr_processes * sizeof(struct snapshot_process);
+	if (w.header.nr_schedules &&
+			fwrite(w.schedules, sizeof(*w.schedules), w.header.nr_schedules,
+				w.file) != w.header.nr_schedules) {
+		w.failed = true;
+	}
+
+	w.header.cpus_offset = w.header.schedules_offset +
+			w.header.nr_schedules * sizeof(struct snapshot_schedule);
+	for (i = 0; i < sim->nr_cpus; i++) {
+		struct snapshot_cpu sc = { 0 };
+
+		if (__save_sched_state(sim, sim->cpus + i, NULL, sc.sched_state)) {
+			sc.flags |= SNAPSHOT_SCHED_STATE;
+		}
+		if (fwrite(&sc, sizeof(sc), 1, w.file) != 1) w.failed = true;
+	}
+	strncpy(w.header.scheduler, sim->sched->name, sizeof(w.header.scheduler) - 1);
+
+	w.header.flags = (sim->__need_resched ? SNAPSHOT_NEED_RESCHED : 0) |
+			(sim->__forkqueue_sorted ? SNAPSHOT_FORKQUEUE_SORTED : 0);
+	w.header.ticks = sim->ticks;
+	w.header.nr_cpus = sim->nr_cpus;
+	w.header.nr_resources = sim->nr_resources;
+	w.header.nr_exited = sim->stats.nr_exited;
+	w.header.turnaround = sim->stats.turnaround;
+	w.header.waiting = sim->stats.waiting;
+
+	if (fseek(w.file, 0, SEEK_SET) ||
+			fwrite(&w.header, sizeof(w.header), 1, w.file) != 1) {
+		w.failed = true;
+	}
+	if (fclose(w.file)) w.failed = true;
+	free(w.schedules);
+
+	if (w.failed || rename(path, filename)) {
+		fprintf(stderr, "Cannot write %s\n", filename);
+		unlink(path);
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * Snapshot mapped into memory to restore
+ */
+struct snapshot_map {
+	char *data;
+	size_t size;
+
+	const struct snapshot_header *header;
+	const struct snapshot_process *processes;
+	const struct snapshot_schedule *schedules;
+	const struct snapshot_cpu *cpus;
+};
+
+static bool __map_snapshot(const char *filename, struct snapshot_map *map)
+{
+	struct stat st;
+	int fd = open(filename, O_RDONLY);
+
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return false;
+	}
+	if (fstat(fd, &st) || st.st_size < sizeof(struct snapshot_header)) {
+		fprintf(stderr, "Invalid snapshot %s\n", filename);
+		close(fd);
+		return false;
+	}
+
+	map->size = st.st_size;
+	map->data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map->data == MAP_FAILED) {
+		fprintf(stderr, "Cannot map %s\n", filename);
+		return false;
+	}
+
+	map->header = (void *)map->data;
+	map->processes = NULL;
+	map->schedules = NULL;
+	map->cpus = NULL;
+	return true;
+}
+
+/**
+ * The schedules of @sp are in bounds, and the held ones are to be released
+ * after the age in the order of the list
+ */
+static bool __valid_schedules(const struct snapshot_map *map,
+		const struct snapshot_process *sp)
+{
+	const struct snapshot_header *header = map->header;
+	const struct snapshot_schedule *ss;
+	uint64_t nr = (uint64_t)sp->nr_pending + sp->nr_holding;
+	uint32_t releases_at = sp->age;
+
+	if (sp->first_schedule > header->nr_schedules ||
+			nr > header->nr_schedules - sp->first_schedule) {
+		return false;
+	}
+
+	ss = map->schedules + sp->first_schedule;
+	for (uint64_t i = 0; i < nr; i++, ss++) {
+		if (ss->resource_id < 0 || ss->resource_id >= header->nr_resources ||
+				ss->at < 0 || ss->duration < 1) {
+			return false;
+		}
+		if (i < sp->nr_pending) continue;
+
+		if (ss->releases_at <= sp->age || ss->releases_at < releases_at ||
+				ss->releases_at - sp->age > ss->duration) {
+			return false;
+		}
+		releases_at = ss->releases_at;
+	}
+	return true;
+}
+
+/**
+ * Check that @map is a snapshot that can be restored as it is; the records
+ * are in bounds, each resource is held by one process at most, and each
+ * processor has one current at most. The records are located in @map once
+ * the header is found sane.
+ */
+static bool __valid_snapshot(struct snapshot_map *map)
+{
+	const struct snapshot_header *header = map->header;
+	unsigned long long *held = NULL, *currents = NULL;
+	bool valid = false;
+
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+			header->version != SNAPSHOT_VERSION ||
+			header->nr_cpus < 1 || header->nr_resources > MAX_RESOURCES ||
+			header->processes_offset % sizeof(uint64_t) ||
+			header->processes_offset > map->size ||
+			header->nr_processes > (map->size - header->processes_offset) /
+				sizeof(struct snapshot_process) ||
+			header->schedules_offset % sizeof(uint32_t) ||
+			header->schedules_offset > map->size ||
+			header->nr_schedules > (map->size - header->schedules_offset) /
+				sizeof(struct snapshot_schedule) ||
+			header->cpus_offset % sizeof(uint64_t) ||
+			header->cpus_offset > map->size ||
+			header->nr_cpus > (map->size - header->cpus_offset) /
+				sizeof(struct snapshot_cpu)) {
+		return false;
+	}
+	map->processes = (void *)(map->data + header->processes_offset);
+	map->schedules = (void *)(map->data + header->schedules_offset);
+	map->cpus = (void *)(map->data + header->cpus_offset);
+
+	held = calloc(BITMAP_WORDS(header->nr_resources) + 1, sizeof(*held));
+	currents = calloc(BITMAP_WORDS(header->nr_cpus), sizeof(*currents));
+	if (!held || !currents) goto out;
+
+	for (uint32_t i = 0; i < header->nr_processes; i++) {
+		const struct snapshot_process *sp = map->processes + i;
+		const struct snapshot_schedule *ss;
+
+		if (sp->state >= NR_SNAPSHOT_STATES || sp->prio > MAX_PRIO ||
+				sp->age > sp->lifespan ||
+				!__valid_schedules(map, sp)) {
+			goto out;
+		}
+		if (sp->state == SNAPSHOT_FORK) {
+			if (sp->flags || sp->nr_holding) goto out;
+			continue;
+		}
+
+		if (sp->cpu >= header->nr_cpus) goto out;
+		if (sp->state == SNAPSHOT_WAIT && (sp->waiting_for < 0 ||
+				sp->waiting_for >= header->nr_resources)) {
+			goto out;
+		}
+		if (sp->flags & SNAPSHOT_CURRENT) {
+			if (bitmap_test(currents, sp->cpu)) goto out;
+			bitmap_set(currents, sp->cpu);
+		}
+
+		ss = map->schedules + sp->first_schedule + sp->nr_pending;
+		for (uint32_t j = 0; j < sp->nr_holding; j++, ss++) {
+			if (bitmap_test(held, ss->resource_id)) goto out;
+			bitmap_set(held, ss->resource_id);
+		}
+	}
+
+	valid = true;
+
+out:
+	free(held);
+	free(currents);
+	return valid;
+}
+
+static void __out_of_memory(struct sim_context *sim)
+{
+	trace_flush(&sim->__trace);
+	fprintf(stderr, "Out of memory while restoring the simulation\n");
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * Build the process of record @sp, and put it into the fork queue if it is
+ * not forked yet
+ */
+static struct process *__restore_process(struct sim_context *sim,
+		const struct snapshot_map *map, const struct snapshot_process *sp)
+{
+	const struct snapshot_schedule *ss = map->schedules + sp->first_schedule;
+	struct process *p = pool_alloc(&sim->__process_pool);
+
+	if (!p) __out_of_memory(sim);
+	memset(p, 0x00, sizeof(*p));
+
+	p->pid = sp->pid;
+	p->__starts_at = sp->starts_at;
+	p->lifespan = sp->lifespan;
+	p->prio = p->prio_orig = sp->prio;
+	p->age = sp->age;
+	p->cpu = sp->cpu;
+	p->status = PROCESS_READY;
+
+	INIT_LIST_HEAD(&p->list);
+	INIT_LIST_HEAD(&p->__resources_to_acquire);
+	INIT_LIST_HEAD(&p->__resources_holding);
+
+	for (uint32_t i = 0; i < sp->nr_pending + sp->nr_holding; i++, ss++) {
+		struct resource_schedule *rs = pool_alloc(&sim->__resource_schedule_pool);
+
+		if (!rs) __out_of_memory(sim);
+
+		rs->resource_id = ss->resource_id;
+		rs->at = ss->at;
+		rs->duration = ss->duration;
+		rs->releases_at = ss->releases_at;
+		list_add_tail(&rs->list, i < sp->nr_pending ?
+				&p->__resources_to_acquire : &p->__resources_holding);
+	}
+
+	if (sp->state == SNAPSHOT_FORK) {
+		list_add_tail(&p->list, &sim->__forkqueue);
+		sim->__nr_forkqueue++;
+	}
+	return p;
+}
+
+/**
+ * Let @p acquire @resource_id again with the scheduler as if it were running,
+ * and return what the scheduler says
+ */
+static bool __reacquire(struct sim_context *sim, struct process *p, int resource_id)
+{
+	struct process *current = sim->cpus[p->cpu].current;
+	bool acquired;
+
+	this_cpu = sim->cpus + p->cpu;
+	this_cpu->current = p;
+	p->status = PROCESS_RUNNING;
+
+	acquired = sim->sched->acquire(resource_id);
+	__sim_update_resource(sim, resource_id);
+
+	this_cpu->current = current;
+	return acquired;
+}
+
+/**
+ * Give the state saved in @state back to the scheduler for @p, or for
+ * @this_cpu if @p is NULL
+ */
+static void __restore_sched_state(struct sim_context *sim, struct process *p,
+		const uint64_t state[])
+{
+	unsigned long long words[SCHED_STATE_WORDS];
+
+	for (unsigned int i = 0; i < SCHED_STATE_WORDS; i++) words[i] = state[i];
+	sim->sched->restore(p, words);
+}
+
+static void __restore_queues(struct sim_context *sim,
+		const struct snapshot_map *map, struct process **processes)
+{
+	const struct snapshot_header *header = map->header;
+	struct process placeholder = {
+		.pid = 0,
+		.status = PROCESS_READY,
+		.waiting_for = -1,
+		.list = LIST_HEAD_INIT(placeholder.list),
+	};
+
+	/* The scheduler that saved the snapshot gets its state back first */
+	if (sim->sched->restore && !strncmp(header->scheduler, sim->sched->name,
+				sizeof(header->scheduler) - 1)) {
+		for (uint32_t i = 0; i < header->nr_cpus; i++) {
+			if (!(map->cpus[i].flags & SNAPSHOT_SCHED_STATE)) continue;
+
+			this_cpu = sim->cpus + i;
+			__restore_sched_state(sim, NULL, map->cpus[i].sched_state);
+		}
+		for (uint32_t i = 0; i < header->nr_processes; i++) {
+			const struct snapshot_process *sp = map->processes + i;
+
+			if (!(sp->flags & SNAPSHOT_SCHED_STATE)) continue;
+
+			this_cpu = sim->cpus + processes[i]->cpu;
+			__restore_sched_state(sim, processes[i], sp->sched_state);
+		}
+	}
+
+	/* Give the held resources back to the owners first */
+	for (uint32_t i = 0; i < header->nr_processes; i++) {
+		struct process *p = processes[i];
+		struct resource_schedule *rs;
+
+		list_for_each_entry(rs, &p->__resources_holding, list) {
+			if (!__reacquire(sim, p, rs->resource_id)) {
+				trace_flush(&sim->__trace);
+				fprintf(stderr, "%s scheduler does not give resource %d back to %d\n",
+						sim->sched->name, rs->resource_id, p->pid);
+				exit(EXIT_FAILURE);
+			}
+			__sim_hold_resource(sim, p, rs->resource_id);
+			p->status = PROCESS_READY;
+		}
+	}
+
+	/* Then block the waiters on them in the order of arrival */
+	for (uint32_t i = 0; i < header->nr_processes; i++) {
+		const struct snapshot_process *sp = map->processes + i;
+		struct process *p = processes[i];
+		struct resource *r;
+
+		if (sp->state != SNAPSHOT_WAIT) continue;
+
+		/**
+		 * The resource was released and its top waiter was woken up, but the
+		 * rest are still waiting. Let them block on a placeholder owner
+		 */
+		r = sim->resources + sp->waiting_for;
+		if (!r->owner) r->owner = &placeholder;
+
+		if (__reacquire(sim, p, sp->waiting_for)) {
+			trace_flush(&sim->__trace);
+			fprintf(stderr, "%s scheduler gives resource %d to %d as well\n",
+					sim->sched->name, sp->waiting_for, p->pid);
+			exit(EXIT_FAILURE);
+		}
+		if (sim->__metrics) {
+			p->__metrics->blocked_since = sim->ticks;
+			p->__metrics->blocked_on = sp->waiting_for;
+		}
+	}
+
+	/* which leaves the resources as they were released */
+	for (uint32_t i = 0; i < header->nr_resources; i++) {
+		struct resource *r = sim->resources + i;
+
+		if (r->owner != &placeholder) continue;
+
+		r->owner = NULL;
+		if (r->prio_waitqueue) r->prio_waitqueue->donated = -1;
+	}
+	if (placeholder.donations) {
+		pool_free(&sim->__donation_pool, placeholder.donations);
+	}
+
+	/* And hand the ready ones to the scheduler as if they were just forked */
+	for (uint32_t i = 0; i < header->nr_processes; i++) {
+		const struct snapshot_process *sp = map->processes + i;
+		struct process *p = processes[i];
+		struct sim_cpu *cpu = sim->cpus + p->cpu;
+
+		if (sp->state == SNAPSHOT_READY) {
+			list_add_tail(&p->list, &cpu->readyqueue);
+			cpu->nr_running++;
+
+			this_cpu = cpu;
+			if (sim->sched->forked) sim->sched->forked(p);
+		} else if (sp->state == SNAPSHOT_RUNNING) {
+			p->status = PROCESS_RUNNING;
+			cpu->nr_running++;
+		}
+		if (sp->flags & SNAPSHOT_CURRENT) {
+			cpu->current = p;
+
+			/* The quantum may be shorter this time */
+			cpu->quantum_left = sp->quantum_left < sim->__quantum ?
+					sp->quantum_left : sim->__quantum;
+		}
+	}
+}
+
+struct sim_context *sim_restore(const char *filename,
+		const struct scheduler *sched, const struct sim_options *options)
+{
+	struct sim_options restored_options = *options;
+	struct sim_context *prev_sim = this_sim;
+	struct sim_cpu *prev_cpu = this_cpu;
+	struct snapshot_map map;
+	const struct snapshot_header *header;
+	struct process **processes = NULL;
+	struct sim_context *sim = NULL;
+
+	if (!__map_snapshot(filename, &map)) return NULL;
+	header = map.header;
+
+	if (!__valid_snapshot(&map)) {
+		fprintf(stderr, "Invalid snapshot %s\n", filename);
+		goto out;
+	}
+	if (options->nr_cpus > 1 && options->nr_cpus != header->nr_cpus) {
+		fprintf(stderr, "%s is taken on %u processor%s\n", filename,
+				header->nr_cpus, header->nr_cpus > 1 ? "s" : "");
+		goto out;
+	}
+	restored_options.nr_cpus = header->nr_cpus;
+
+	sim = sim_create(sched, &restored_options);
+	if (!sim) goto out;
+
+	if (!__sim_reserve_resources(sim, header->nr_resources)) __out_of_memory(sim);
+
+	sim->ticks = header->ticks;
+	sim->stats.nr_forked = header->nr_exited;
+	sim->stats.nr_exited = header->nr_exited;
+	sim->stats.turnaround = header->turnaround;
+	sim->stats.waiting = header->waiting;
+	sim->__need_resched = header->flags & SNAPSHOT_NEED_RESCHED;
+	sim->__forkqueue_sorted = header->flags & SNAPSHOT_FORKQUEUE_SORTED;
+
+	if (header->nr_processes) {
+		processes = malloc(sizeof(*processes) * header->nr_processes);
+		if (!processes) __out_of_memory(sim);
+	}
+
+	for (uint32_t i = 0; i < header->nr_processes; i++) {
+		const struct snapshot_process *sp = map.processes + i;
+
+		processes[i] = __restore_process(sim, &map, sp);
+		if (sp->state != SNAPSHOT_FORK) sim->stats.nr_forked++;
+
+		/**
+		 * The metrics count from the restored tick on; the processes that
+		 * have run are taken as they ran first at the tick
+		 */
+		if (sim->__metrics && sp->state != SNAPSHOT_FORK) {
+			if (!metrics_fork_process(sim->__metrics, processes[i], sim->ticks)) {
+				__out_of_memory(sim);
+			}
+			if (sp->age) processes[i]->__metrics->first_run = sim->ticks;
+		}
+	}
+
+	this_sim = sim;
+	__restore_queues(sim, &map, processes);
+	this_sim = prev_sim;
+	this_cpu = prev_cpu;
+
+	free(processes);
+
+out:
+	munmap(map.data, map.size);
+	return sim;
+}
@@ -0,0 +1,112 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdint.h>
+
+/**
+ * Snapshot of a simulation between ticks. sim_checkpoint() writes it, and
+ * sim_restore() maps it into memory to go on simulating from the tick,
+ * possibly with another scheduler.
+ *
+ * Like the compiled workload (see workload.h), the file consists of the
+ * header, the table of process records, and the array of resource
+ * schedules. @first_schedule of each record refers to @nr_pending schedules
+ * to acquire followed by @nr_holding schedules being held, in the order of
+ * the lists. The records are written in the order below, and restoring
+ * rebuilds the queues in the same order:
+ *
+ *   1. Processes not forked yet, in the order of the fork queue
+ *   2. Processes running on each processor
+ *   3. Ready processes of each processor, in @readyqueue and then in the
+ *      order the scheduler would pick them (see for_each_ready())
+ *   4. Processes waiting for each resource, in the order of arrival
+ *
+ * The table of processor records follows the schedules. The state the
+ * scheduler keeps for each process and processor (see save() of struct
+ * scheduler) is given back only to the scheduler named @scheduler.
+ *
+ * All fields are in the host byte order.
+ */
+#define SNAPSHOT_MAGIC		"PSIMSNAP"
+#define SNAPSHOT_VERSION	2
+
+/* Flags of the simulation */
+#define SNAPSHOT_NEED_RESCHED		0x1
+#define SNAPSHOT_FORKQUEUE_SORTED	0x2
+
+struct snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	uint32_t ticks;
+	uint32_t nr_cpus;
+	uint32_t nr_resources;
+	uint32_t nr_processes;
+	uint64_t nr_schedules;
+	uint64_t nr_exited;			/* struct sim_stats */
+	uint64_t turnaround;
+	uint64_t waiting;
+	uint64_t processes_offset;	/* From the beginning of the file */
+	uint64_t schedules_offset;
+	uint64_t cpus_offset;
+	char scheduler[32];			/* The name of the scheduler */
+};
+
+enum snapshot_state {
+	SNAPSHOT_FORK,		/* Not forked yet */
+	SNAPSHOT_RUNNING,	/* Running on @cpu */
+	SNAPSHOT_READY,		/* Ready to run on @cpu */
+	SNAPSHOT_WAIT,		/* Waiting for resource @waiting_for */
+	NR_SNAPSHOT_STATES,
+};
+
+/* Flags of a process */
+#define SNAPSHOT_CURRENT	0x1		/* The current of @cpu */
+#define SNAPSHOT_SCHED_STATE	0x2	/* @sched_state is saved */
+
+struct snapshot_process {
+	uint32_t pid;
+	uint32_t starts_at;
+	uint32_t lifespan;
+	uint32_t prio;			/* The original priority */
+	uint32_t age;
+	uint32_t state;
+	uint32_t flags;
+	uint32_t cpu;
+	int32_t waiting_for;
+	uint32_t nr_pending;
+	uint32_t nr_holding;
+	uint32_t quantum_left;	/* Ticks left in the quantum of the current */
+	uint64_t first_schedule;
+	uint64_t sched_state[SCHED_STATE_WORDS];
+};
+
+struct snapshot_schedule {
+	int32_t resource_id;
+	int32_t at;
+	int32_t duration;
+	int32_t releases_at;
+};
+
+struct snapshot_cpu {
+	uint32_t flags;			/* SNAPSHOT_SCHED_STATE */
+	uint32_t reserved;
+	uint64_t sched_state[SCHED_STATE_WORDS];
+};
+
+#endif
@@ -0,0 +1,97 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "thread_pool.h"
+
+struct thread_pool {
+	pthread_mutex_t lock;
+	unsigned int next_job;		/* Protected by @lock */
+	unsigned int nr_jobs;
+
+	thread_pool_job_t fn;
+	void *arg;
+};
+
+unsigned int thread_pool_nr_cpus(void)
+{
+	long nr = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return nr > 0 ? nr : 1;
+}
+
+static bool __next_job(struct thread_pool *pool, unsigned int *job)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->next_job < pool->nr_jobs) {
+		*job = pool->next_job++;
+		found = true;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return found;
+}
+
+static void *__worker(void *data)
+{
+	struct thread_pool *pool = data;
+	unsigned int job;
+
+	while (__next_job(pool, &job)) {
+		pool->fn(pool->arg, job);
+	}
+	return NULL;
+}
+
+void thread_pool_run(unsigned int nr_workers, unsigned int nr_jobs,
+		thread_pool_job_t fn, void *arg)
+{
+	struct thread_pool pool = {
+		.next_job = 0,
+		.nr_jobs = nr_jobs,
+		.fn = fn,
+		.arg = arg,
+	};
+	pthread_t *threads;
+	unsigned int nr_threads = 0;
+
+	if (nr_workers > nr_jobs) nr_workers = nr_jobs;
+
+	pthread_mutex_init(&pool.lock, NULL);
+
+	/* The calling thread works as well, so spawn one less */
+	threads = nr_workers > 1 ? malloc(sizeof(*threads) * (nr_workers - 1)) : NULL;
+	if (threads) {
+		while (nr_threads < nr_workers - 1 &&
+				pthread_create(threads + nr_threads, NULL, __worker, &pool) == 0) {
+			nr_threads++;
+		}
+	}
+
+	__worker(&pool);
+
+	for (unsigned int i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	pthread_mutex_destroy(&pool.lock);
+}
@@ -0,0 +1,45 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+/**
+ * Minimal pool of worker threads to run independent jobs in parallel. The
+ * jobs are numbered from 0, and each idle worker takes the next one until
+ * all of them are done. The jobs should not share any mutable state.
+ */
+typedef void (*thread_pool_job_t)(void *arg, unsigned int job);
+
+/***********************************************************************
+ * thread_pool_nr_cpus()
+ *
+ * DESCRIPTION
+ *   The number of online processors, as the default number of workers.
+ */
+unsigned int thread_pool_nr_cpus(void);
+
+/***********************************************************************
+ * thread_pool_run()
+ *
+ * DESCRIPTION
+ *   Run @fn(@arg, i) for i in [0, @nr_jobs) on up to @nr_workers threads,
+ *   and wait for all of them to complete. The jobs are run on the calling
+ *   thread if @nr_workers is 1 or a thread cannot be created.
+ */
+void thread_pool_run(unsigned int nr_workers, unsigned int nr_jobs,
+		thread_pool_job_t fn, void *arg);
+
+#endif
@@ -0,0 +1,516 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "trace.h"
+
+/**
+ * Longest record except the indentation; tick, processor, event, and " xN"
+ * suffix
+ */
+#define MAX_RECORD_LEN	64
+
+/**
+ * The digest starts from @DIGEST_SEED, and each event is folded into it
+ * word by word with a multiply and a shift
+ */
+#define DIGEST_SEED		0xcbf29ce484222325ULL
+#define DIGEST_PRIME	0x9e3779b97f4a7c15ULL
+
+int trace_init(struct trace *trace, int fd)
+{
+	trace->fd = fd;
+	trace->compact = false;
+	trace->compress = false;
+	trace->show_cpu = false;
+
+	trace->size = TRACE_BUFFER_SIZE;
+	trace->len = 0;
+	trace->buffer = malloc(trace->size);
+	if (!trace->buffer) return -1;
+
+	trace->nr_events = 0;
+	trace->nr_bytes = 0;
+	trace->failed = false;
+
+	trace->digest = false;
+	trace->hash = DIGEST_SEED;
+	trace->digests = NULL;
+	trace->nr_digests = 0;
+	trace->max_digests = 0;
+	trace->idle.pid = 0;
+	trace->idle.hash = DIGEST_SEED;
+	trace->idle.nr_events = 0;
+
+	return 0;
+}
+
+void trace_fini(struct trace *trace)
+{
+	trace_flush(trace);
+
+	free(trace->buffer);
+	trace->buffer = NULL;
+
+	free(trace->digests);
+	trace->digests = NULL;
+}
+
+void trace_flush(struct trace *trace)
+{
+	static const char message[] = "Cannot write the trace\n";
+	size_t written = 0;
+
+	/* Once failed, the rest is dropped not to complain again */
+	while (written < trace->len && !trace->failed) {
+		ssize_t ret = write(trace->fd, trace->buffer + written,
+				trace->len - written);
+		if (ret < 0 && errno == EINTR) continue;
+		if (ret <= 0) {
+			trace->failed = true;
+			(void)write(STDERR_FILENO, message, sizeof(message) - 1);
+			break;
+		}
+		written += ret;
+	}
+
+	trace->nr_bytes += written;
+	trace->len = 0;
+}
+
+static inline void __reserve(struct trace *trace, size_t len)
+{
+	if (trace->len + len > trace->size) {
+		trace_flush(trace);
+	}
+}
+
+static inline void __put_char(struct trace *trace, char c)
+{
+	trace->buffer[trace->len++] = c;
+}
+
+static inline void __put_string(struct trace *trace, const char *str, size_t len)
+{
+	memcpy(trace->buffer + trace->len, str, len);
+	trace->len += len;
+}
+
+/**
+ * Put @value right-aligned in @width columns like printf("%*u")
+ */
+static inline void __put_uint(struct trace *trace, unsigned int value, int width)
+{
+	char digits[16];
+	int nr = 0;
+
+	do {
+		digits[nr++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+
+	for (; width > nr; width--) {
+		__put_char(trace, ' ');
+	}
+	while (nr) {
+		__put_char(trace, digits[--nr]);
+	}
+}
+
+/**
+ * Indent by @pid levels (four spaces each). The indentation is not bounded,
+ * so put it in pieces not to overflow the buffer. In the compact mode, the
+ * pid is printed instead except for the runs which print the pid anyway.
+ */
+static void __put_indent(struct trace *trace, unsigned int pid,
+		enum trace_type type)
+{
+	size_t len = (size_t)pid * 4;
+
+	if (trace->compact) {
+		if (type != TRACE_RUN) {
+			__put_uint(trace, pid, 0);
+			__put_char(trace, ' ');
+		}
+		return;
+	}
+
+	while (len) {
+		size_t room;
+
+		__reserve(trace, MAX_RECORD_LEN + 1);
+		room = trace->size - trace->len - MAX_RECORD_LEN;
+		if (room > len) room = len;
+
+		memset(trace->buffer + trace->len, ' ', room);
+		trace->len += room;
+		len -= room;
+	}
+	__reserve(trace, MAX_RECORD_LEN);
+}
+
+static void __put_record(struct trace *trace, unsigned int tick, unsigned int cpu,
+		unsigned int pid, enum trace_type type, int arg, unsigned int nr)
+{
+	__reserve(trace, MAX_RECORD_LEN);
+
+	__put_uint(trace, tick, 3);
+	__put_string(trace, ": ", 2);
+
+	if (trace->show_cpu) {
+		__put_char(trace, '[');
+		__put_uint(trace, cpu, 0);
+		__put_string(trace, "] ", 2);
+	}
+
+	if (type == TRACE_IDLE) {
+		__put_string(trace, "idle", 4);
+	} else {
+		__put_indent(trace, pid, type);
+
+		switch (type) {
+		case TRACE_FORK:
+			__put_char(trace, 'N');
+			break;
+		case TRACE_EXIT:
+			__put_char(trace, 'X');
+			break;
+		case TRACE_BLOCK:
+			__put_char(trace, '=');
+			break;
+		case TRACE_ACQUIRE:
+		case TRACE_RELEASE:
+			__put_char(trace, type == TRACE_ACQUIRE ? '+' : '-');
+			if (arg < 0) {
+				__put_char(trace, '-');
+				arg = -arg;
+			}
+			__put_uint(trace, arg, 0);
+			break;
+		case TRACE_RUN:
+			__put_uint(trace, pid, 0);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (nr > 1) {
+		__put_string(trace, " x", 2);
+		__put_uint(trace, nr, 0);
+	}
+	__put_char(trace, '\n');
+}
+
+static inline unsigned long long __mix(unsigned long long hash,
+		unsigned long long word)
+{
+	hash = (hash ^ word) * DIGEST_PRIME;
+	return hash ^ (hash >> 29);
+}
+
+static inline unsigned long long __fold(unsigned long long hash,
+		unsigned int tick, unsigned int cpu, unsigned int pid,
+		enum trace_type type, int arg)
+{
+	hash = __mix(hash, (unsigned long long)tick << 32 | cpu);
+	hash = __mix(hash, (unsigned long long)pid << 32 | type);
+	return __mix(hash, (unsigned int)arg);
+}
+
+static inline size_t __pid_slot(unsigned int pid, size_t max)
+{
+	return (pid * DIGEST_PRIME >> 32) & (max - 1);
+}
+
+/**
+ * Double the table of the process digests. Slots with no events are empty
+ */
+static void __grow_digests(struct trace *trace)
+{
+	size_t max = trace->max_digests ? trace->max_digests * 2 : 1024;
+	struct trace_digest *digests = calloc(max, sizeof(*digests));
+
+	if (!digests) {
+		trace_flush(trace);
+		fprintf(stderr, "Out of memory while digesting the trace\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i < trace->max_digests; i++) {
+		struct trace_digest *d = trace->digests + i;
+		size_t slot;
+
+		if (!d->nr_events) continue;
+
+		for (slot = __pid_slot(d->pid, max); digests[slot].nr_events;
+				slot = (slot + 1) & (max - 1));
+		digests[slot] = *d;
+	}
+
+	free(trace->digests);
+	trace->digests = digests;
+	trace->max_digests = max;
+}
+
+static struct trace_digest *__process_digest(struct trace *trace, unsigned int pid)
+{
+	struct trace_digest *d;
+	size_t slot;
+
+	if ((trace->nr_digests + 1) * 2 > trace->max_digests) {
+		__grow_digests(trace);
+	}
+
+	for (slot = __pid_slot(pid, trace->max_digests); ;
+			slot = (slot + 1) & (trace->max_digests - 1)) {
+		d = trace->digests + slot;
+
+		if (!d->nr_events) {
+			d->pid = pid;
+			d->hash = DIGEST_SEED;
+			trace->nr_digests++;
+			return d;
+		}
+		if (d->pid == pid) return d;
+	}
+}
+
+/**
+ * Fold @nr events, one per tick from @tick, into the digests. The fields
+ * that the text trace does not show are left out, so that the records
+ * parsed back from it fold the same
+ */
+static void __digest_events(struct trace *trace, unsigned int tick,
+		unsigned int cpu, unsigned int pid, enum trace_type type, int arg,
+		unsigned int nr)
+{
+	struct trace_digest *d;
+
+	if (!trace->show_cpu) cpu = 0;
+	if (type != TRACE_ACQUIRE && type != TRACE_RELEASE) arg = 0;
+
+	if (type == TRACE_IDLE) {
+		pid = 0;
+		d = &trace->idle;
+	} else {
+		d = __process_digest(trace, pid);
+	}
+
+	for (unsigned int i = 0; i < nr; i++) {
+		trace->hash = __fold(trace->hash, tick + i, cpu, pid, type, arg);
+		d->hash = __fold(d->hash, tick + i, cpu, pid, type, arg);
+	}
+	d->nr_events += nr;
+}
+
+void trace_event(struct trace *trace, unsigned int tick, unsigned int cpu,
+		unsigned int pid, enum trace_type type, int arg)
+{
+	if (trace->digest) {
+		__digest_events(trace, tick, cpu, pid, type, arg, 1);
+	} else {
+		__put_record(trace, tick, cpu, pid, type, arg, 1);
+	}
+	trace->nr_events++;
+}
+
+void trace_repeat(struct trace *trace, unsigned int tick, unsigned int cpu,
+		unsigned int pid, enum trace_type type, unsigned int nr)
+{
+	if (trace->digest) {
+		if (nr) __digest_events(trace, tick, cpu, pid, type, 0, nr);
+	} else if (trace->compress) {
+		if (nr) __put_record(trace, tick, cpu, pid, type, 0, nr);
+	} else {
+		for (unsigned int i = 0; i < nr; i++) {
+			__put_record(trace, tick + i, cpu, pid, type, 0, 1);
+		}
+	}
+	trace->nr_events += nr;
+}
+
+static int __compare_digests(const void *a, const void *b)
+{
+	const struct trace_digest *x = a, *y = b;
+
+	return x->pid < y->pid ? -1 : x->pid > y->pid;
+}
+
+static void __put_digest(struct trace *trace, const char *name,
+		unsigned int pid, const struct trace_digest *d)
+{
+	__reserve(trace, MAX_RECORD_LEN);
+
+	if (name) {
+		trace->len += snprintf(trace->buffer + trace->len, MAX_RECORD_LEN,
+				"%s %016llx %llu\n", name, d->hash, d->nr_events);
+	} else {
+		trace->len += snprintf(trace->buffer + trace->len, MAX_RECORD_LEN,
+				"%u %016llx %llu\n", pid, d->hash, d->nr_events);
+	}
+}
+
+void trace_write_digest(struct trace *trace)
+{
+	struct trace_digest total = {
+		.hash = trace->hash,
+		.nr_events = trace->nr_events,
+	};
+	size_t nr = 0;
+
+	__put_digest(trace, "digest", 0, &total);
+
+	/* Pack the table to sort by pids. It is not looked up anymore */
+	for (size_t i = 0; i < trace->max_digests; i++) {
+		if (trace->digests[i].nr_events) {
+			trace->digests[nr++] = trace->digests[i];
+		}
+	}
+	qsort(trace->digests, nr, sizeof(*trace->digests), __compare_digests);
+
+	for (size_t i = 0; i < nr; i++) {
+		__put_digest(trace, NULL, trace->digests[i].pid, trace->digests + i);
+	}
+	if (trace->idle.nr_events) __put_digest(trace, "idle", 0, &trace->idle);
+
+	free(trace->digests);
+	trace->digests = NULL;
+	trace->nr_digests = 0;
+	trace->max_digests = 0;
+}
+
+/**
+ * Parse the event of a record from @str; the indented or compact one, or
+ * the run of a process. Return the end of it, or NULL if it is malformed
+ */
+static char *__parse_event(char *str, unsigned int *pid, enum trace_type *type,
+		int *arg)
+{
+	size_t indent = strspn(str, " ");
+	char *end;
+
+	str += indent;
+	if (isdigit((unsigned char)*str)) {
+		unsigned long nr = strtoul(str, &end, 10);
+
+		/* Prefixed with the pid in the compact trace */
+		if (end[0] == ' ' && end[1] && strchr("NX=+-", end[1])) {
+			*pid = nr;
+			str = end + 1;
+		} else {
+			*pid = nr;
+			*type = TRACE_RUN;
+			return end;
+		}
+	} else {
+		if (indent % 4) return NULL;
+		*pid = indent / 4;
+	}
+
+	switch (*str++) {
+	case 'N':
+		*type = TRACE_FORK;
+		return str;
+	case 'X':
+		*type = TRACE_EXIT;
+		return str;
+	case '=':
+		*type = TRACE_BLOCK;
+		return str;
+	case '+':
+	case '-':
+		*type = str[-1] == '+' ? TRACE_ACQUIRE : TRACE_RELEASE;
+		if (!isdigit((unsigned char)*str) && *str != '-') return NULL;
+		*arg = strtol(str, &end, 10);
+		return end;
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * Fold the record in @line. Return 1 if it is folded, 0 if @line is not a
+ * record, or -1 if it is malformed
+ */
+static int __digest_record(struct trace *trace, char *line)
+{
+	unsigned int tick, cpu = 0, pid = 0, nr = 1;
+	enum trace_type type;
+	int arg = 0;
+	char *str = line + strspn(line, " ");
+	char *end;
+
+	if (!isdigit((unsigned char)*str)) return 0;
+
+	tick = strtoul(str, &end, 10);
+	if (end[0] != ':') return 0;
+	if (end[1] != ' ') return -1;
+	str = end + 2;
+
+	if (*str == '[') {
+		cpu = strtoul(str + 1, &end, 10);
+		if (end[0] != ']' || end[1] != ' ') return -1;
+		str = end + 2;
+	}
+
+	if (!strncmp(str, "idle", 4)) {
+		type = TRACE_IDLE;
+		str += 4;
+	} else {
+		str = __parse_event(str, &pid, &type, &arg);
+		if (!str) return -1;
+	}
+
+	if (!strncmp(str, " x", 2)) {
+		nr = strtoul(str + 2, &end, 10);
+		if (end == str + 2) return -1;
+		str = end;
+	}
+	if (*str != '\n' && *str != '\0') return -1;
+
+	__digest_events(trace, tick, cpu, pid, type, arg, nr);
+	trace->nr_events += nr;
+	return 1;
+}
+
+unsigned long trace_digest_text(struct trace *trace, FILE *file)
+{
+	char *line = NULL;
+	size_t len = 0;
+	unsigned long nr_lines = 0;
+	unsigned long malformed = 0;
+
+	/* Records without processors are on processor 0 */
+	trace->show_cpu = true;
+
+	while (getline(&line, &len, file) >= 0) {
+		nr_lines++;
+
+		if (__digest_record(trace, line) < 0) {
+			malformed = nr_lines;
+			break;
+		}
+	}
+	free(line);
+	return malformed;
+}
@@ -0,0 +1,162 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "types.h"
+
+/**
+ * Events in the simulation trace, and how they are printed
+ */
+enum trace_type {
+	TRACE_FORK,		/* N */
+	TRACE_EXIT,		/* X */
+	TRACE_BLOCK,	/* = */
+	TRACE_ACQUIRE,	/* +n */
+	TRACE_RELEASE,	/* -n */
+	TRACE_RUN,		/* pid */
+	TRACE_IDLE,		/* idle */
+};
+
+/**
+ * Digest of the events of a process, or of the idle records if @pid is
+ * the idle one
+ */
+struct trace_digest {
+	unsigned int pid;
+	unsigned long long hash;
+	unsigned long long nr_events;
+};
+
+/**
+ * Buffered trace writer. Events are formatted into @buffer and written to
+ * @fd in large chunks when the buffer is full or on trace_flush().
+ */
+struct trace {
+	int fd;					/* File descriptor to write the trace to */
+	bool compact;			/* Prefix the events with pid instead of
+							   indenting them */
+	bool compress;			/* Print repeated events as "... xN" */
+	bool show_cpu;			/* Print the processor after the tick */
+
+	char *buffer;
+	size_t size;
+	size_t len;				/* # of bytes pending in @buffer */
+
+	unsigned long long nr_events;	/* # of events traced */
+	unsigned long long nr_bytes;	/* # of bytes written to @fd */
+	bool failed;			/* Could not write to @fd */
+
+	/**
+	 * In the digest mode, the events are folded into @hash instead of being
+	 * formatted, and into the digest of the process in @digests, an open
+	 * addressing table of @max_digests entries. trace_write_digest() writes
+	 * them out at the end.
+	 */
+	bool digest;
+	unsigned long long hash;
+	struct trace_digest *digests;
+	size_t nr_digests;
+	size_t max_digests;
+	struct trace_digest idle;
+};
+
+#define TRACE_BUFFER_SIZE	(1 << 20)
+
+/***********************************************************************
+ * trace_init()
+ *
+ * DESCRIPTION
+ *   Initialize @trace to write to @fd. Return 0 on success, or -1 if the
+ *   trace buffer cannot be allocated.
+ */
+int trace_init(struct trace *trace, int fd);
+
+/***********************************************************************
+ * trace_fini()
+ *
+ * DESCRIPTION
+ *   Flush pending events and release the buffer of @trace.
+ */
+void trace_fini(struct trace *trace);
+
+/***********************************************************************
+ * trace_event()
+ *
+ * DESCRIPTION
+ *   Trace event @type of process @pid on processor @cpu at @tick. @arg is
+ *   the resource id for TRACE_ACQUIRE and TRACE_RELEASE, and is ignored
+ *   otherwise. @pid is ignored for TRACE_IDLE.
+ */
+void trace_event(struct trace *trace, unsigned int tick, unsigned int cpu,
+		unsigned int pid, enum trace_type type, int arg);
+
+/***********************************************************************
+ * trace_repeat()
+ *
+ * DESCRIPTION
+ *   Trace @nr consecutive TRACE_RUN or TRACE_IDLE events, one per tick,
+ *   starting from @tick. They are folded into a single "... xN" record if
+ *   @trace->compress is set.
+ */
+void trace_repeat(struct trace *trace, unsigned int tick, unsigned int cpu,
+		unsigned int pid, enum trace_type type, unsigned int nr);
+
+/***********************************************************************
+ * trace_write_digest()
+ *
+ * DESCRIPTION
+ *   Write the digest of the events traced so far, followed by the digest of
+ *   each process in the ascending order of pids and that of the idle
+ *   records, one in a line:
+ *
+ *     digest <hash> <# of events>
+ *     <pid> <hash> <# of events>
+ *     idle <hash> <# of events>
+ *
+ *   The hashes are in 16 hexadecimal digits.
+ */
+void trace_write_digest(struct trace *trace);
+
+/***********************************************************************
+ * trace_digest_text()
+ *
+ * DESCRIPTION
+ *   Fold the records of the text trace in @file into the digest of @trace,
+ *   as if they were traced in the digest mode. The records may be indented
+ *   or compact, with or without processors, and compressed; lines that are
+ *   not records are skipped. So the digest of a trace printed before
+ *   matches that of running the simulation in the digest mode.
+ *
+ * RETURN
+ *   0 on success, or the line number of the first malformed record
+ */
+unsigned long trace_digest_text(struct trace *trace, FILE *file);
+
+/***********************************************************************
+ * trace_flush()
+ *
+ * DESCRIPTION
+ *   Write out the pending events. This only uses write(2), so it is safe
+ *   to call from a signal handler. A failure is reported once on stderr,
+ *   and sets @trace->failed; the events are dropped from then on.
+ */
+void trace_flush(struct trace *trace);
+
+#endif
@@ -0,0 +1,60 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __WORKLOAD_H__
+#define __WORKLOAD_H__
+
+#include <stdint.h>
+
+/**
+ * Compiled workload file. A process script is compiled into this format
+ * with the -o option, and the framework maps it into memory to simulate
+ * without parsing the text again.
+ *
+ * The file consists of the header, the table of process records, and the
+ * array of resource schedules. The process records are sorted by
+ * @starts_at (in the script order among the same start ticks), and each
+ * record refers to @nr_schedules entries from @first_schedule in the
+ * schedule array. All fields are in the host byte order.
+ */
+#define WORKLOAD_MAGIC		"PSIMWKLD"
+#define WORKLOAD_VERSION	1
+
+struct workload_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_processes;
+	uint64_t nr_schedules;
+	uint64_t processes_offset;	/* From the beginning of the file */
+	uint64_t schedules_offset;
+};
+
+struct workload_process {
+	uint32_t pid;
+	uint32_t starts_at;
+	uint32_t lifespan;
+	uint32_t prio;
+	uint64_t first_schedule;
+	uint32_t nr_schedules;
+	uint32_t __reserved;
+};
+
+struct workload_schedule {
+	int32_t resource_id;
+	int32_t at;
+	int32_t duration;
+};
+
+#endif